@@ -49,6 +49,15 @@ capi = Extension(
      'src/varint.c',
      'src/varyad.c',
      'src/varyadobject.c',
+     'src/zigzag.c',
+     'src/delta.c',
+     'src/bitpack.c',
+     'src/groupvarint.c',
+     'src/polyfile.c',
+     'src/polyfileobject.c',
+     'src/polyloaderobject.c',
+     'src/polylog.c',
+     'src/polylogobject.c',
      ],
 )
 
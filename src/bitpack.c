@@ -0,0 +1,202 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <string.h>
+#include "bitpack.h"
+#include "varint.h"
+
+/* bytes past a block's bit stream read by the 64-bit unpacking loads */
+#define BITPACK_SLACK 9
+
+static inline uint64_t
+bp_load64(const uint8_t *p)
+{
+    uint64_t x;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&x, p, sizeof(x));
+#else
+    int i;
+    x = 0;
+    for (i = 7; i >= 0; i--) {
+        x = x << 8 | p[i];
+    }
+#endif
+    return x;
+}
+
+static inline void
+bp_store(uint8_t *p, uint64_t x, size_t n)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (n == sizeof(x)) {
+        memcpy(p, &x, sizeof(x));
+        return;
+    }
+#endif
+    for (; n; n--) {
+        *p++ = x;
+        x >>= 8;
+    }
+}
+
+/* The size of the bit stream of {@code m} integers of width {@code w} */
+static inline size_t
+bp_bytes(size_t m, unsigned w)
+{
+    return (m * w + 7) / 8;
+}
+
+static size_t
+bp_pack_block(size_t m, const uint64_t *src, uint8_t *dst, size_t len)
+{
+    uint64_t lo, hi, acc, v;
+    size_t off, j;
+    unsigned w, bits;
+
+    lo = hi = src[0];
+    for (j = 1; j < m; j++) {
+        lo = src[j] < lo ? src[j] : lo;
+        hi = src[j] > hi ? src[j] : hi;
+    }
+    w = hi == lo ? 0 : 64 - __builtin_clzll(hi - lo);
+
+    off = size_to_vi(lo, dst, len);
+    if (!off)
+        return 0;
+    if (len - off < 1 + bp_bytes(m, w)) {
+        errno = EINVAL;
+        return 0;
+    }
+    dst[off++] = w;
+    if (!w)
+        return off;
+
+    acc = 0;
+    bits = 0;
+    for (j = 0; j < m; j++) {
+        v = src[j] - lo;
+        acc |= v << bits;
+        bits += w;
+        if (bits >= 64) {
+            bp_store(dst + off, acc, 8);
+            off += 8;
+            bits -= 64;
+            acc = bits ? v >> (w - bits) : 0;
+        }
+    }
+    bp_store(dst + off, acc, (bits + 7) / 8);
+    return off + (bits + 7) / 8;
+}
+
+size_t
+bitpack64(size_t n, const uint64_t *src, void *dst, size_t len)
+{
+    uint8_t *const p = dst;
+    size_t off, i, m, k;
+    off = 0;
+    for (i = 0; i < n; i += m) {
+        m = n - i < BITPACK_BLOCK ? n - i : BITPACK_BLOCK;
+        k = bp_pack_block(m, src + i, p + off, len - off);
+        if (!k)
+            return 0;
+        off += k;
+    }
+    return off;
+}
+
+/*
+ * Unpack {@code m} integers of width {@code w} from a bit stream followed
+ * by at least BITPACK_SLACK readable bytes.  Always inlined, so that each
+ * case of bp_unpack_block gets a loop specialized for a constant width,
+ * with constant shifts and masks the compiler can unroll and vectorize.
+ */
+static inline __attribute__((always_inline)) void
+bp_unpack(const uint8_t *src, unsigned w, uint64_t base, size_t m, uint64_t *dst)
+{
+    const uint64_t mask = w < 64 ? ((uint64_t) 1 << w) - 1 : ~(uint64_t) 0;
+    size_t j, b;
+    uint64_t x;
+    for (j = 0; j < m; j++) {
+        b = j * w;
+        x = bp_load64(src + b / 8) >> (b % 8);
+        if (w > 56 && b % 8) {
+            x |= (uint64_t) src[b / 8 + 8] << (64 - b % 8);
+        }
+        dst[j] = base + (x & mask);
+    }
+}
+
+#define BP_CASE(w) case w: bp_unpack(src, w, base, m, dst); break;
+#define BP_CASE8(w) BP_CASE(w + 1) BP_CASE(w + 2) BP_CASE(w + 3) BP_CASE(w + 4) \
+    BP_CASE(w + 5) BP_CASE(w + 6) BP_CASE(w + 7) BP_CASE(w + 8)
+
+static void
+bp_unpack_block(const uint8_t *src, unsigned w, uint64_t base, size_t m, uint64_t *dst)
+{
+    size_t j;
+    switch (w) {
+    case 0:
+        for (j = 0; j < m; j++) {
+            dst[j] = base;
+        }
+        break;
+    BP_CASE8(0) BP_CASE8(8) BP_CASE8(16) BP_CASE8(24)
+    BP_CASE8(32) BP_CASE8(40) BP_CASE8(48) BP_CASE8(56)
+    }
+}
+
+#undef BP_CASE8
+#undef BP_CASE
+
+size_t
+bitunpack64(const void *src, size_t len, size_t n, uint64_t *dst)
+{
+    const uint8_t *const p = src;
+    uint8_t pad[BITPACK_BLOCK * 8 + BITPACK_SLACK];
+    size_t off, i, m, k, base;
+    unsigned w;
+    off = 0;
+    for (i = 0; i < n; i += m) {
+        m = n - i < BITPACK_BLOCK ? n - i : BITPACK_BLOCK;
+        k = vi_to_size(p + off, len - off, &base);
+        if (!k)
+            return 0;
+        off += k;
+        if (off == len || p[off] > 64) {
+            errno = EINVAL;
+            return 0;
+        }
+        w = p[off++];
+        k = bp_bytes(m, w);
+        if (len - off < k) {
+            errno = EINVAL;
+            return 0;
+        }
+        if (len - off - k >= BITPACK_SLACK) {
+            bp_unpack_block(p + off, w, base, m, dst + i);
+        } else {
+            /* too close to the end of the buffer for 64-bit loads */
+            memcpy(pad, p + off, k);
+            memset(pad + k, 0, BITPACK_SLACK);
+            bp_unpack_block(pad, w, base, m, dst + i);
+        }
+        off += k;
+    }
+    return off;
+}
@@ -0,0 +1,69 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _bitpack_h_DEFINED
+#define _bitpack_h_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "varint.h"
+
+/**
+ * bitpack - frame-of-reference bit packing of integer arrays
+ *
+ * Integers are packed in blocks of {@code BITPACK_BLOCK}, the last block
+ * possibly shorter.  Each block is the varint of its least value (the
+ * base), a byte holding the bit width of the largest offset from the
+ * base, and the offsets as a little-endian bit stream of that width,
+ * padded to a whole byte.
+ */
+
+/** The number of integers in each block **/
+#define BITPACK_BLOCK 128
+
+/** The worst-case packed size of {@code n} integers **/
+#define BITPACK_MAX_SIZE(n) \
+    (((n) + BITPACK_BLOCK - 1) / BITPACK_BLOCK * (VI_MAX_LEN + 1) + (n) * 8)
+
+/**
+ * Pack an array of integers into blocks.
+ *
+ * @param n the number of integers
+ * @param src the integers to pack
+ * @param dst the destination buffer
+ * @param len the size of the destination buffer
+ * @return the number of bytes written to {@code dst}
+ * @error ERANGE the base of a block would overflow the maximum supported varint
+ * @error EINVAL {@code len} is too small to contain the blocks
+ */
+size_t bitpack64(size_t n, const uint64_t *src, void *dst, size_t len);
+
+/**
+ * Unpack an array of integers packed by {@code bitpack64}.
+ *
+ * @param src the source buffer
+ * @param len the size of the source buffer
+ * @param n the number of integers
+ * @param dst an array of size {@code n} to store the integers
+ * @return the number of bytes read
+ * @error ERANGE the base of a block would overflow this architechture's size
+ * @error EINVAL {@code len} is too small to read the blocks, or a bit width is invalid
+ */
+size_t bitunpack64(const void *src, size_t len, size_t n, uint64_t *dst);
+
+#endif /* _bitpack_h_DEFINED */
@@ -0,0 +1,81 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include "delta.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+uint64_t
+delta64_array(size_t n, const uint64_t *src, uint64_t *dst, uint64_t prev)
+{
+    size_t i;
+    uint64_t x;
+    i = 0;
+#if defined(__SSE2__)
+    if (n >= 2) {
+        __m128i p = _mm_cvtsi64_si128(prev);
+        for (; i + 2 <= n; i += 2) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+            /* [prev, v0] is v shifted up one lane */
+            const __m128i s = _mm_unpacklo_epi64(p, v);
+            p = _mm_unpackhi_epi64(v, v);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_sub_epi64(v, s));
+        }
+        prev = _mm_cvtsi128_si64(p);
+    }
+#endif
+    for (; i < n; i++) {
+        x = src[i];
+        dst[i] = x - prev;
+        prev = x;
+    }
+    return prev;
+}
+
+uint64_t
+prefix64_array(size_t n, const uint64_t *src, uint64_t *dst, uint64_t prev)
+{
+    size_t i;
+    i = 0;
+#if defined(__SSE2__)
+    if (n >= 4) {
+        __m128i c = _mm_set1_epi64x(prev);
+        for (; i + 4 <= n; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 2));
+            /* in-lane sums first: one add per four integers waits on the carry */
+            a = _mm_add_epi64(a, _mm_slli_si128(a, 8));
+            b = _mm_add_epi64(b, _mm_slli_si128(b, 8));
+            b = _mm_add_epi64(b, _mm_unpackhi_epi64(a, a));
+            a = _mm_add_epi64(a, c);
+            b = _mm_add_epi64(b, c);
+            _mm_storeu_si128((__m128i *)(dst + i), a);
+            _mm_storeu_si128((__m128i *)(dst + i + 2), b);
+            c = _mm_unpackhi_epi64(b, b);
+        }
+        prev = _mm_cvtsi128_si64(c);
+    }
+#endif
+    for (; i < n; i++) {
+        prev += src[i];
+        dst[i] = prev;
+    }
+    return prev;
+}
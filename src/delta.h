@@ -0,0 +1,51 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _delta_h_DEFINED
+#define _delta_h_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * delta - differences and prefix sums of integer arrays, modulo 2^64
+ */
+
+/**
+ * Replace each integer with its difference from the preceding one.
+ *
+ * @param n the number of integers
+ * @param src the source array
+ * @param dst the destination array (may be {@code src})
+ * @param prev the integer preceding {@code src[0]}
+ * @return the last source integer, to continue with the next array
+ */
+uint64_t delta64_array(size_t n, const uint64_t *src, uint64_t *dst, uint64_t prev);
+
+/**
+ * Replace each integer with the running sum, inverting {@code delta64_array}.
+ *
+ * @param n the number of integers
+ * @param src the source array
+ * @param dst the destination array (may be {@code src})
+ * @param prev the sum preceding {@code src[0]}
+ * @return the last sum, to continue with the next array
+ */
+uint64_t prefix64_array(size_t n, const uint64_t *src, uint64_t *dst, uint64_t prev);
+
+#endif /* _delta_h_DEFINED */
@@ -0,0 +1,220 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <string.h>
+#include "groupvarint.h"
+
+/* bytes read after a control byte by the 64-bit loads of a full group */
+#define GVI_SLACK 32
+
+/* the decoder stores the size_t sizes and offsets as uint64_t */
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "groupvarint requires a 64-bit size_t");
+
+/*
+ * The location of each integer of a group, indexed by control byte: the
+ * offset of each integer after the control byte and the total length.
+ */
+static const struct gvi_group {
+    uint8_t off[4];
+    uint8_t len;
+} gvi_groups[256] = {
+#define GVI_L(c, i) (1 << ((c) >> (2 * (i)) & 3))
+#define GVI_G(c) { { 0, GVI_L(c, 0), GVI_L(c, 0) + GVI_L(c, 1), \
+        GVI_L(c, 0) + GVI_L(c, 1) + GVI_L(c, 2) }, \
+        GVI_L(c, 0) + GVI_L(c, 1) + GVI_L(c, 2) + GVI_L(c, 3) },
+#define GVI_G4(c) GVI_G(c) GVI_G(c + 1) GVI_G(c + 2) GVI_G(c + 3)
+#define GVI_G16(c) GVI_G4(c) GVI_G4(c + 4) GVI_G4(c + 8) GVI_G4(c + 12)
+#define GVI_G64(c) GVI_G16(c) GVI_G16(c + 16) GVI_G16(c + 32) GVI_G16(c + 48)
+    GVI_G64(0) GVI_G64(64) GVI_G64(128) GVI_G64(192)
+#undef GVI_G64
+#undef GVI_G16
+#undef GVI_G4
+#undef GVI_G
+#undef GVI_L
+};
+
+static const uint64_t gvi_masks[4] = {
+    0xffULL, 0xffffULL, 0xffffffffULL, 0xffffffffffffffffULL
+};
+
+static inline uint64_t
+gvi_load64(const uint8_t *p)
+{
+    uint64_t x;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&x, p, sizeof(x));
+#else
+    int i;
+    x = 0;
+    for (i = 7; i >= 0; i--) {
+        x = x << 8 | p[i];
+    }
+#endif
+    return x;
+}
+
+/* The control code of {@code x}: the log2 of its length in bytes */
+static inline unsigned
+gvi_code(uint64_t x)
+{
+    return (x > 0xff) + (x > 0xffff) + (x > 0xffffffff);
+}
+
+size_t
+sizes_to_gvi(size_t n, const size_t *src, void *dst, size_t len)
+{
+    uint8_t *const p = dst;
+    size_t off, i, j, k, m;
+    unsigned c, code;
+    off = 0;
+    for (i = 0; i < n; i += 4) {
+        k = n - i < 4 ? n - i : 4;
+        c = 0;
+        for (j = 0; j < k; j++) {
+            c |= gvi_code(src[i + j]) << (2 * j);
+        }
+        if (len - off < 1 + (size_t) gvi_groups[c].len) {
+            errno = EINVAL;
+            return 0;
+        }
+        p[off++] = c;
+        for (j = 0; j < k; j++) {
+            code = c >> (2 * j) & 3;
+            for (m = 0; m < (1u << code); m++) {
+                p[off++] = (uint64_t) src[i + j] >> (8 * m);
+            }
+        }
+    }
+    return off;
+}
+
+/* Read {@code k} integers of a group one byte at a time */
+static inline void
+gvi_read(const uint8_t *p, unsigned c, size_t k, uint64_t *x)
+{
+    size_t j, m, off;
+    unsigned code;
+    off = 0;
+    for (j = 0; j < k; j++) {
+        code = c >> (2 * j) & 3;
+        x[j] = 0;
+        for (m = 0; m < (1u << code); m++) {
+            x[j] |= (uint64_t) p[off++] << (8 * m);
+        }
+    }
+}
+
+/*
+ * Decode {@code n} integers, storing each one (or, when {@code sum} is
+ * set, the running sum before it, failing with ERANGE on overflow) and
+ * returning the number of bytes read.
+ * Full groups with GVI_SLACK bytes after their control byte are decoded
+ * with four masked 64-bit loads, others byte by byte.
+ */
+static inline __attribute__((always_inline)) size_t
+gvi_decode(const uint8_t *p, size_t len, size_t n, int sum, uint64_t *run, uint64_t *dst)
+{
+    const struct gvi_group *g;
+    uint64_t x[4];
+    size_t off, i, j, k;
+    unsigned c;
+    off = 0;
+    for (i = 0; i < n; i += 4) {
+        if (off == len) {
+            errno = EINVAL;
+            return 0;
+        }
+        c = p[off];
+        g = &gvi_groups[c];
+        k = n - i < 4 ? n - i : 4;
+        if (k == 4 && len - off > GVI_SLACK) {
+            x[0] = gvi_load64(p + off + 1 + g->off[0]) & gvi_masks[c & 3];
+            x[1] = gvi_load64(p + off + 1 + g->off[1]) & gvi_masks[c >> 2 & 3];
+            x[2] = gvi_load64(p + off + 1 + g->off[2]) & gvi_masks[c >> 4 & 3];
+            x[3] = gvi_load64(p + off + 1 + g->off[3]) & gvi_masks[c >> 6];
+            off += 1 + g->len;
+        } else {
+            /* the length of the first k integers, trailing codes being zero */
+            j = k < 4 ? g->off[k] : g->len;
+            if (len - off - 1 < j || (k < 4 && c >> (2 * k))) {
+                errno = EINVAL;
+                return 0;
+            }
+            gvi_read(p + off + 1, c, k, x);
+            off += 1 + j;
+        }
+        for (j = 0; j < k; j++) {
+            if (sum) {
+                if (x[j] > UINT64_MAX - *run) {
+                    errno = ERANGE;
+                    return 0;
+                }
+                dst[i + j] = *run;
+                *run += x[j];
+            } else {
+                dst[i + j] = x[j];
+            }
+        }
+    }
+    return off;
+}
+
+size_t
+gvi_to_sizes(const void *src, size_t len, size_t n, size_t *dst)
+{
+    return gvi_decode(src, len, n, 0, NULL, (uint64_t *) dst);
+}
+
+size_t
+gvi_len(const void *src, size_t len, size_t n)
+{
+    const uint8_t *const p = src;
+    size_t off, i, k, m;
+    unsigned c;
+    off = 0;
+    for (i = 0; i < n; i += 4) {
+        if (off >= len) {
+            errno = EINVAL;
+            return 0;
+        }
+        c = p[off];
+        k = n - i < 4 ? n - i : 4;
+        /* the length of the first k integers, checked before the next group */
+        m = k < 4 ? gvi_groups[c].off[k] : gvi_groups[c].len;
+        if (len - off - 1 < m) {
+            errno = EINVAL;
+            return 0;
+        }
+        off += 1 + m;
+    }
+    return off;
+}
+
+size_t
+gvi_to_offsets(const void *src, size_t len, size_t n, size_t start, size_t *dst)
+{
+    uint64_t run;
+    size_t off;
+    run = start;
+    off = gvi_decode(src, len, n, 1, &run, (uint64_t *) dst);
+    if (off || !n) {
+        dst[n] = run;
+    }
+    return off;
+}
@@ -0,0 +1,90 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _groupvarint_h_DEFINED
+#define _groupvarint_h_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * groupvarint - sizes stored in groups of four behind a control byte
+ *
+ * Each group is a control byte followed by up to four little-endian
+ * integers.  Bits {@code 2i} and {@code 2i+1} of the control byte give the
+ * length of the {@code i}-th integer as {@code 1 << code} bytes (1, 2, 4
+ * or 8), so a group's integers can be located with one table lookup.  A
+ * final group of fewer than four integers has zero codes for the missing
+ * integers and no bytes for them.  Sizes are decoded as 64-bit integers,
+ * so a {@code size_t} must be 64 bits wide.
+ */
+
+/** The worst-case size of {@code n} group varints **/
+#define GVI_MAX_SIZE(n) (((n) + 3) / 4 + (n) * 8)
+
+/**
+ * Store an array of sizes as group varints.
+ *
+ * @param n the number of sizes
+ * @param src the sizes to store
+ * @param dst the destination buffer
+ * @param len the size of the destination buffer
+ * @return the number of bytes written to {@code dst}
+ * @error EINVAL {@code len} is too small to contain the group varints
+ */
+size_t sizes_to_gvi(size_t n, const size_t *src, void *dst, size_t len);
+
+/**
+ * Read an array of sizes stored as group varints.
+ *
+ * @param src the source buffer
+ * @param len the size of the source buffer
+ * @param n the number of sizes
+ * @param dst an array of size {@code n} to store the sizes
+ * @return the number of bytes read
+ * @error EINVAL {@code len} is too small to read the group varints
+ */
+size_t gvi_to_sizes(const void *src, size_t len, size_t n, size_t *dst);
+
+/**
+ * The stored length of {@code n} group varints, from their control bytes.
+ *
+ * @param src the source buffer
+ * @param len the size of the source buffer
+ * @param n the number of sizes
+ * @return the number of bytes spanned by the group varints
+ * @error EINVAL {@code len} is too small to hold the group varints
+ */
+size_t gvi_len(const void *src, size_t len, size_t n);
+
+/**
+ * Read group varint sizes as the offsets of consecutive items.
+ *
+ * @param src the source buffer
+ * @param len the size of the source buffer
+ * @param n the number of sizes
+ * @param start the offset of the first item
+ * @param dst an array of size {@code n + 1} to store the offset of each
+ *            item and the end offset of the last
+ * @return the number of bytes read
+ * @error EINVAL {@code len} is too small to read the group varints
+ * @error ERANGE the offsets would overflow 64 bits
+ */
+size_t gvi_to_offsets(const void *src, size_t len, size_t n, size_t start, size_t *dst);
+
+#endif /* _groupvarint_h_DEFINED */
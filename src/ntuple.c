@@ -20,25 +20,37 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ntuple.h"
+#include "bitpack.h"
+#include "groupvarint.h"
 #include "varint.h"
+#include "zigzag.h"
+#include "delta.h"
+
+/* elements transformed per pass, a whole number of bit-packed blocks */
+#define NTUPLE_CHUNK (2 * BITPACK_BLOCK)
+
+/* The extended header: an overlong zero varint, then a format byte */
+#define NTUPLE_EXTENDED(p, size) \
+    ((size) >= 2 && ((const uint8_t *) (p))[0] == 0x80 && ((const uint8_t *) (p))[1] == 0)
+
+/* Flags transforming elements on their way to and from the packed form */
+#define NTUPLE_TRANSFORMS (NTUPLE_ZIGZAG | NTUPLE_DELTA | NTUPLE_DELTA2)
+
+/* the transforms read and write the size_t elements as uint64_t */
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "ntuple requires a 64-bit size_t");
 
 size_t
 ntuple_size(size_t rank, const size_t *info)
 {
-    size_t size, n, i;
+    size_t size, n;
     size = 0;
     n = size_to_vi(rank, NULL, -1);
     if (n) {
-        size = n;
-        for (i = 0; i < rank; i++) {
-            n = size_to_vi(info[i], NULL, -1);
-            if (n) {
-                size += n;
-            } else {
-                size = 0;
-                break;
-            }
+        size = sizes_vi_len(rank, info);
+        if (size || !rank) {
+            size += n;
         }
     }
     return size;
@@ -47,47 +59,64 @@ ntuple_size(size_t rank, const size_t *info)
 size_t
 ntuple_pack(size_t rank, const size_t *info, void *data, size_t size)
 {
-    size_t off, n, i;
+    size_t off, n;
     off = 0;
     n = size_to_vi(rank, data, size);
     if (n) {
-        off = n;
-        for (i = 0; i < rank; i++) {
-            n = size_to_vi(info[i], data + off, size - off);
-            if (n) {
-                off += n;
-            } else {
-                off = 0;
-                break;
-            }
+        off = sizes_to_vi(rank, info, data + n, size - n);
+        if (off || !rank) {
+            off += n;
         }
     }
     return off;
 }
 
+int
+ntuple_format(const void *data, size_t size)
+{
+    if (NTUPLE_EXTENDED(data, size)) {
+        /* a plain ntuple never has an extended header, so it can't claim one */
+        if (size < 3 || ((const uint8_t *) data)[2] == NTUPLE_FORMAT_VARINT) {
+            return -1;
+        }
+        return ((const uint8_t *) data)[2];
+    }
+    return NTUPLE_FORMAT_VARINT;
+}
+
 size_t
 ntuple_rank(const void *data, size_t size, size_t *rank)
 {
+    const int format = ntuple_format(data, size);
+    size_t n;
+    if (format != NTUPLE_FORMAT_VARINT) {
+        if (format < NTUPLE_FORMAT_BITPACK || format > NTUPLE_FORMAT_INDEXED) {
+            errno = EINVAL;
+            return 0;
+        }
+        n = vi_to_size(data + 3, size - 3, rank);
+        return n ? n + 3 : 0;
+    }
     return vi_to_size(data, size, rank);
 }
 
 size_t
 ntuple_load(const void *data, size_t size, size_t rank, size_t *info)
 {
-    size_t off, n, i, x;
+    size_t off, n, x;
+    if (NTUPLE_EXTENDED(data, size)) {
+        return ntuple_decode(data, size, 0, rank, info);
+    }
     off = 0;
     n = vi_to_size(data, size, &x);
     if (n) {
         if (x == rank) {
             off = n;
-            for (i = 0; i < rank; i++) {
-                n = vi_to_size(data + off, size - off, &info[i]);
-                if (n) {
-                    off += n;
-                } else {
-                    off = 0;
-                    break;
-                }
+            n = vi_to_sizes(data + off, size - off, rank, info);
+            if (n || !rank) {
+                off += n;
+            } else {
+                off = 0;
             }
         } else {
             errno = EINVAL;
@@ -95,3 +124,96 @@ ntuple_load(const void *data, size_t size, size_t rank, size_t *info)
     }
     return off;
 }
+
+size_t
+ntuple_encode(size_t rank, const size_t *info, int flags, void *data, size_t size)
+{
+    uint64_t buf[NTUPLE_CHUNK], last[2];
+    const uint64_t *src;
+    size_t off, n, i, m;
+    if (!(flags & (NTUPLE_TRANSFORMS | NTUPLE_BITPACK | NTUPLE_GROUP))) {
+        return ntuple_pack(rank, info, data, size);
+    }
+    last[0] = last[1] = 0;
+    off = 0;
+    if (flags & (NTUPLE_BITPACK | NTUPLE_GROUP)) {
+        if (size < 3 || (flags & NTUPLE_BITPACK && flags & NTUPLE_GROUP)) {
+            errno = EINVAL;
+            return 0;
+        }
+        memcpy(data, "\x80\x00", 2);
+        ((uint8_t *) data)[2] = flags & NTUPLE_BITPACK ?
+                NTUPLE_FORMAT_BITPACK : NTUPLE_FORMAT_GROUP;
+        off = 3;
+    }
+    n = size_to_vi(rank, data + off, size - off);
+    off = n ? off + n : 0;
+    for (i = 0; off && i < rank; i += m) {
+        m = rank - i < NTUPLE_CHUNK ? rank - i : NTUPLE_CHUNK;
+        src = (const uint64_t *) info + i;
+        if (flags & (NTUPLE_DELTA | NTUPLE_DELTA2)) {
+            last[0] = delta64_array(m, src, buf, last[0]);
+            src = buf;
+        }
+        if (flags & NTUPLE_DELTA2) {
+            last[1] = delta64_array(m, buf, buf, last[1]);
+        }
+        if (flags & NTUPLE_ZIGZAG) {
+            zig64_array(m, (const int64_t *) src, buf);
+            src = buf;
+        }
+        if (flags & NTUPLE_BITPACK) {
+            n = bitpack64(m, src, data + off, size - off);
+        } else if (flags & NTUPLE_GROUP) {
+            n = sizes_to_gvi(m, (const size_t *) src, data + off, size - off);
+        } else {
+            n = sizes_to_vi(m, (const size_t *) src, data + off, size - off);
+        }
+        off = n ? off + n : 0;
+    }
+    return off;
+}
+
+size_t
+ntuple_decode(const void *data, size_t size, int flags, size_t rank, size_t *info)
+{
+    uint64_t *const dst = (uint64_t *) info;
+    uint64_t last[2];
+    size_t off, n, i, m, x;
+    int format;
+    format = ntuple_format(data, size);
+    if (format == NTUPLE_FORMAT_VARINT && !(flags & NTUPLE_TRANSFORMS)) {
+        return ntuple_load(data, size, rank, info);
+    }
+    last[0] = last[1] = 0;
+    off = ntuple_rank(data, size, &x);
+    if (off && (x != rank || format == NTUPLE_FORMAT_INDEXED)) {
+        errno = EINVAL;
+        off = 0;
+    }
+    for (i = 0; off && i < rank; i += m) {
+        m = rank - i < NTUPLE_CHUNK ? rank - i : NTUPLE_CHUNK;
+        if (format == NTUPLE_FORMAT_BITPACK) {
+            n = bitunpack64(data + off, size - off, m, dst + i);
+        } else if (format == NTUPLE_FORMAT_GROUP) {
+            n = gvi_to_sizes(data + off, size - off, m, info + i);
+        } else {
+            n = vi_to_sizes(data + off, size - off, m, info + i);
+        }
+        if (!n) {
+            off = 0;
+            break;
+        }
+        off += n;
+        if (flags & NTUPLE_ZIGZAG) {
+            zag64_array(m, dst + i, (int64_t *) dst + i);
+        }
+        if (flags & NTUPLE_DELTA2) {
+            last[1] = prefix64_array(m, dst + i, dst + i, last[1]);
+        }
+        if (flags & (NTUPLE_DELTA | NTUPLE_DELTA2)) {
+            last[0] = prefix64_array(m, dst + i, dst + i, last[0]);
+        }
+    }
+    return off;
+}
@@ -21,11 +21,41 @@
 #define _ntuple_h_DEFINED
 
 #include <stddef.h>
+#include "bitpack.h"
+#include "groupvarint.h"
+#include "varint.h"
 
 /**
  * ntuple - an n-tuple of natural numbers packed as varints
  */
 
+/** The worst-case packed size of an ntuple of rank {@code n} **/
+#define NTUPLE_MAX_SIZE(n) VI_MAX_SIZE((n) + 1)
+
+/** The worst-case packed size of an ntuple of rank {@code n} with NTUPLE_BITPACK **/
+#define NTUPLE_BITPACK_MAX_SIZE(n) (3 + VI_MAX_LEN + BITPACK_MAX_SIZE(n))
+
+/** The worst-case packed size of an ntuple of rank {@code n} with NTUPLE_GROUP **/
+#define NTUPLE_GROUP_MAX_SIZE(n) (3 + VI_MAX_LEN + GVI_MAX_SIZE(n))
+
+/** Packed formats, as read by {@code ntuple_format} **/
+#define NTUPLE_FORMAT_VARINT 0
+#define NTUPLE_FORMAT_BITPACK 1
+#define NTUPLE_FORMAT_GROUP 2
+/** Packed formats: a polyad offset table (see polyad.h), whose rank alone is readable **/
+#define NTUPLE_FORMAT_INDEXED 3
+
+/** Encoding flags: elements are signed, stored zig-zag encoded **/
+#define NTUPLE_ZIGZAG 0x1
+/** Encoding flags: elements are stored as differences from the previous **/
+#define NTUPLE_DELTA 0x2
+/** Encoding flags: elements are stored as differences of differences **/
+#define NTUPLE_DELTA2 0x4
+/** Encoding flags: elements are stored in bit-packed blocks **/
+#define NTUPLE_BITPACK 0x8
+/** Encoding flags: elements are stored as group varints **/
+#define NTUPLE_GROUP 0x10
+
 /**
  * Compute the packed size of an ntuple from an array of natural numbers.
  *
@@ -39,6 +69,9 @@ size_t ntuple_size(size_t rank, const size_t *info);
 /**
  * Pack an ntuple from an array of natural numbers.
  *
+ * With a destination of at least {@code NTUPLE_MAX_SIZE(rank)} bytes the
+ * ntuple is packed in a single pass, returning its exact packed size.
+ *
  * @param rank the number of elements in the ntuple
  * @param info the elements to be stored in the ntuple
  * @param data the destination buffer
@@ -49,6 +82,17 @@ size_t ntuple_size(size_t rank, const size_t *info);
  */
 size_t ntuple_pack(size_t rank, const size_t *info, void *data, size_t size);
 
+/**
+ * Read the packed format of an ntuple, without validating it.
+ *
+ * @param data the source buffer
+ * @param size the size of the source buffer
+ * @return the format byte of an extended ntuple header,
+ *         {@code NTUPLE_FORMAT_VARINT} for a plain ntuple, or -1 for an
+ *         extended header that is truncated or claims the plain format
+ */
+int ntuple_format(const void *data, size_t size);
+
 /**
  * Read the rank of an ntuple from a data buffer.
  *
@@ -57,7 +101,7 @@ size_t ntuple_pack(size_t rank, const size_t *info, void *data, size_t size);
  * @param rank the address to store the rank
  * @return the number of bytes read
  * @error ERANGE the rank varint would overflow this architechture's size
- * @error EINVAL {@code size} is too small to read the rank
+ * @error EINVAL {@code size} is too small to read the rank, or the format is unknown
  */
 size_t ntuple_rank(const void *data, size_t size, size_t *rank);
 
@@ -74,4 +118,52 @@ size_t ntuple_rank(const void *data, size_t size, size_t *rank);
  */
 size_t ntuple_load(const void *data, size_t size, size_t rank, size_t *info);
 
-#endif /* _varint_h_DEFINED */
+/**
+ * Pack an ntuple from an array of numbers, transformed per {@code flags}.
+ *
+ * With {@code NTUPLE_ZIGZAG} the elements are read as signed integers
+ * ({@code int64_t}) and zig-zag encoded while packing.  With
+ * {@code NTUPLE_DELTA} each element is stored as its difference from the
+ * previous one, and with {@code NTUPLE_DELTA2} as the difference of such
+ * differences; without {@code NTUPLE_ZIGZAG} a negative difference is out
+ * of range, so these suit sorted (or, for delta2, evenly spaced) input.
+ *
+ * With {@code NTUPLE_BITPACK} the elements are stored in frame-of-reference
+ * bit-packed blocks (see bitpack.h) after an extended header: an overlong
+ * zero varint {@code 0x80 0x00} that canonical ntuples never begin with,
+ * a format byte, then the rank.  {@code ntuple_rank} and the loaders
+ * recognize this header, so a bit-packed ntuple is read like any other.
+ * {@code NTUPLE_GROUP} likewise stores the elements as group varints (see
+ * groupvarint.h), and may not be combined with {@code NTUPLE_BITPACK}.
+ * The transforms work on the elements in place as 64-bit integers, so
+ * this library requires a 64-bit {@code size_t}.
+ *
+ * @param rank the number of elements in the ntuple
+ * @param info the elements to be stored in the ntuple
+ * @param flags the encoding flags
+ * @param data the destination buffer
+ * @param size the size of the destination buffer
+ * @return the number of bytes written to {@code data}
+ * @error ERANGE an encoded value would overflow the maximum supported varint,
+ *               or be a negative difference
+ * @error EINVAL {@code size} is too small to contain the ntuple, or
+ *               {@code flags} are invalid
+ */
+size_t ntuple_encode(size_t rank, const size_t *info, int flags, void *data, size_t size);
+
+/**
+ * Read an ntuple packed by {@code ntuple_encode} with the same {@code flags},
+ * except for the packed format which is read from the ntuple itself.
+ *
+ * @param data the source buffer
+ * @param size the size of the source buffer
+ * @param flags the encoding flags
+ * @param rank the number of elements in the ntuple
+ * @param info an array of size {@code rank} to store the elements
+ * @return the number of bytes read
+ * @error ERANGE a varint value would overflow this architechture's size
+ * @error EINVAL {@code size} is too small to read the ntuple, or {@code rank} is invalid
+ */
+size_t ntuple_decode(const void *data, size_t size, int flags, size_t rank, size_t *info);
+
+#endif /* _ntuple_h_DEFINED */
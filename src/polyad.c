@@ -20,142 +20,764 @@
 #include <sys/types.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "polyad.h"
+#include "polyadicts_inline.h"
 #include "ntuple.h"
-
-struct polyad {
-    size_t rank;
-    void * data;
-    size_t item[];
-};
+#include "groupvarint.h"
 
 size_t
 polyad_rank(const struct polyad *p)
 {
-    return p->rank;
+    return polyad_rank_inline(p);
 }
 
 size_t
 polyad_size(const struct polyad *p)
 {
-    return p->item[p->rank];
+    return polyad_size_inline(p);
 }
 
 const void *
 polyad_data(const struct polyad *p)
 {
-    return p->data;
+    return polyad_data_inline(p);
 }
 
-static inline const void *
-_item_buf(const struct polyad *p, size_t i)
+size_t
+polyad_item(const struct polyad *p, size_t i, const void **item)
 {
-    return ((const char *) p->data) + p->item[i];
+    return polyad_item_inline(p, i, item);
 }
 
-static inline size_t
-_item_len(const struct polyad *p, size_t i)
+/* the polyad was allocated by this module, and is freed by polyad_free */
+#define POLYAD_ALLOCATED 0x100
+
+/* the load flags kept by a polyad */
+#define POLYAD_LOAD_FLAGS (POLYAD_LAZY | POLYAD_VERIFY | POLYAD_TRUST)
+
+/*
+ * the greatest rank of a polyad builder, for which its offset table and
+ * header space (under 20 bytes an item) take at most two thirds of SIZE_MAX
+ */
+#define POLYAD_BUILDER_RANK_MAX (SIZE_MAX / 32)
+
+/* the greatest capacity whose POLYAD_SIZEOF does not overflow */
+#define POLYAD_CAPACITY_MAX ((SIZE_MAX - POLYAD_SIZEOF(0)) / sizeof(size_t))
+
+/* the least number of item sizes decoded by each lazy resolution */
+#define POLYAD_RESOLVE 8
+
+/* The rank of the offsets stored in a polyad struct for a header */
+static size_t
+polyad_capacity(const void *data, size_t size, size_t rank)
 {
-    return p->item[i + 1] - p->item[i];
+    return ntuple_format(data, size) == NTUPLE_FORMAT_INDEXED ? 0 : rank;
 }
 
-size_t
-polyad_item(const struct polyad *p, size_t i, const void **item)
+_Static_assert(POLYAD_SIZEOF(0) == sizeof(struct polyad) + sizeof(size_t),
+        "POLYAD_SIZEOF does not match struct polyad");
+
+/*
+ * Read the item offsets of a polyad into {@code p}, given its rank and
+ * the length {@code n} of the header up to the item sizes.  A lazy polyad
+ * only locates the header end, as the offset of its first item, and an
+ * indexed polyad its offset table.  Offsets are bounded by {@code size}
+ * per the load flags of {@code p}.
+ */
+static size_t
+polyad_read(const void *data, size_t size, size_t rank, size_t n, struct polyad *p)
 {
-    if (i < p->rank) {
-        *item = _item_buf(p, i);
-        return _item_len(p, i);
+    const int format = ntuple_format(data, size);
+    /* the bound of item offsets, only checked against overflow unless verified */
+    const size_t limit = p->flags & POLYAD_VERIFY ? size : SIZE_MAX;
+    size_t off, i, w;
+    p->rank = rank;
+    p->data = (void *) data;
+    p->ready = rank + 1;
+    p->flags &= ~_POLYAD_INDEXED;
+    if (format == NTUPLE_FORMAT_INDEXED) {
+        /* the table width, then rank + 1 offsets from the header end */
+        off = 0;
+        w = n < size ? ((const uint8_t *) data)[n] : 0;
+        if (w && w <= 8 && !(w & (w - 1)) && (size - n - 1) / w > rank) {
+            p->flags |= _POLYAD_INDEXED;
+            p->width = w;
+            p->next = n + 1;
+            p->item[0] = n + 1 + (rank + 1) * w;
+            off = _polyad_offset(p, rank);
+            if (p->flags & POLYAD_TRUST) {
+                return off;
+            }
+            /* each offset within the buffer, when verified */
+            for (i = 0; p->flags & POLYAD_VERIFY && i < rank && off; i++) {
+                if (_polyad_offset(p, i) > _polyad_offset(p, i + 1)) {
+                    off = 0;
+                }
+            }
+        }
+        if (off < p->item[0] || off > size) {
+            errno = EINVAL;
+            off = 0;
+        }
+    } else if (p->flags & POLYAD_LAZY && !(p->flags & POLYAD_VERIFY) &&
+            format != NTUPLE_FORMAT_BITPACK) {
+        if (format == NTUPLE_FORMAT_GROUP) {
+            off = gvi_len(data + n, size - n, rank);
+        } else {
+            off = vi_span(data + n, size - n, rank);
+        }
+        if (off || !rank) {
+            off += n;
+            p->item[0] = off;
+            p->next = n;
+            p->ready = 1;
+        }
+    } else if (format == NTUPLE_FORMAT_GROUP) {
+        /* find the header end, then read offsets four at a time */
+        off = gvi_len(data + n, size - n, rank);
+        if (off || !rank) {
+            off += n;
+            if (gvi_to_offsets(data + n, size - n, rank, off, p->item) || !rank) {
+                off = p->item[rank];
+            } else {
+                off = 0;
+            }
+            if (off > limit) {
+                errno = EINVAL;
+                off = 0;
+            }
+        }
     } else {
-        *item = NULL;
-        errno = EINVAL;
-        return 0;
+        /* read the item sizes */
+        off = ntuple_decode(data, size, 0, rank, p->item);
+        /* convert the sizes to data offsets, checking each in the same pass */
+        for (i = 0; off && i < rank; i++) {
+            n = p->item[i];
+            p->item[i] = off;
+            if (n > limit - off) {
+                errno = p->flags & POLYAD_VERIFY ? EINVAL : ERANGE;
+                off = 0;
+            } else {
+                off += n;
+            }
+        }
+        p->item[rank] = off;
     }
+    return off;
 }
 
-#define SIZEOF_POLYAD(rank) (sizeof(struct polyad) + sizeof(size_t) * ((rank) + 1))
+int
+_polyad_resolve(const struct polyad *cp, size_t k)
+{
+    /* the offsets are a cache, filled in behind the const polyad */
+    struct polyad *const p = (struct polyad *) cp;
+    const char *const data = p->data;
+    const size_t end = p->item[0];
+    size_t s, m, n, j;
+    if (k < p->ready) {
+        return 1;
+    }
+    /* decode sizes s to s + m - 1 into offsets s + 1 to s + m */
+    s = p->ready - 1;
+    m = k - s < POLYAD_RESOLVE ? POLYAD_RESOLVE : k - s;
+    if (ntuple_format(data, end) == NTUPLE_FORMAT_GROUP) {
+        /* whole groups, s being a multiple of four */
+        m = (m + 3) & ~(size_t) 3;
+        m = m < p->rank - s ? m : p->rank - s;
+        n = gvi_to_offsets(data + p->next, end - p->next, m, p->item[s], p->item + s);
+    } else {
+        m = m < p->rank - s ? m : p->rank - s;
+        n = vi_to_sizes(data + p->next, end - p->next, m, p->item + s + 1);
+        for (j = s + 1; n && j <= s + m; j++) {
+            p->item[j] += p->item[j - 1];
+        }
+    }
+    if (!n) {
+        return 0;
+    }
+    p->next += n;
+    p->ready = s + m + 1;
+    return 1;
+}
 
 size_t
 polyad_load(const void *data, size_t size, const struct polyad **dst)
 {
-    size_t rank, off, n, i;
+    return polyad_load_ex(data, size, 0, NULL, 0, dst);
+}
+
+size_t
+polyad_load_into(const void *data, size_t size, void *mem, size_t memlen,
+        const struct polyad **dst)
+{
+    return polyad_load_ex(data, size, 0, mem, memlen, dst);
+}
+
+size_t
+polyad_sizeof(const void *data, size_t size)
+{
+    size_t rank, cap;
+    if (!ntuple_rank(data, size, &rank)) {
+        return 0;
+    }
+    cap = polyad_capacity(data, size, rank);
+    if (cap > POLYAD_CAPACITY_MAX) {
+        errno = ENOMEM;
+        return 0;
+    }
+    return POLYAD_SIZEOF(cap);
+}
+
+size_t
+polyad_load_ex(const void *data, size_t size, int flags, void *mem, size_t memlen,
+        const struct polyad **dst)
+{
+    size_t rank, cap, off, n;
     struct polyad *p;
     off = 0;
     *dst = NULL;
+    if ((flags & POLYAD_VERIFY) && (flags & POLYAD_TRUST)) {
+        errno = EINVAL;
+        return 0;
+    }
     /* read the ntuple/polyad rank and allocate */
-    n = vi_to_size(data, size, &rank);
-    if (n) {
-        p = malloc(SIZEOF_POLYAD(rank));
-        if (p) {
-            /* read the item sizes */
-            p->rank = rank;
-            p->data = (void *) data;
-            off = n;
-            for (i = 0; i < rank; i++) {
-                n = vi_to_size(data + off, size - off, &p->item[i]);
-                if (n) {
-                    off += n;
-                } else {
-                    break;
-                }
-            }
-            if (i == rank) {
-                /* convert the sizes to data offsets */
-                for (i = 0; i < rank; i++) {
-                    n = p->item[i];
-                    p->item[i] = off;
-                    off += n;
-                }
-                p->item[rank] = off;
-                /* store the result in destination address */
-                *dst = p;
-            } else {
-                free(p);
-                off = 0;
+    n = ntuple_rank(data, size, &rank);
+    if (!n) {
+        return 0;
+    }
+    cap = polyad_capacity(data, size, rank);
+    if (cap > POLYAD_CAPACITY_MAX) {
+        /* an untrusted rank, whose storage size would wrap */
+        errno = ENOMEM;
+        return 0;
+    }
+    if (mem) {
+        if (memlen < POLYAD_SIZEOF(cap)) {
+            errno = ENOMEM;
+            return 0;
+        }
+        p = mem;
+        p->capacity = (memlen - POLYAD_SIZEOF(0)) / sizeof(size_t);
+        p->flags = flags & POLYAD_LOAD_FLAGS;
+    } else {
+        p = malloc(POLYAD_SIZEOF(cap));
+        if (!p) {
+            return 0;
+        }
+        p->capacity = cap;
+        p->flags = (flags & POLYAD_LOAD_FLAGS) | POLYAD_ALLOCATED;
+    }
+    off = polyad_read(data, size, rank, n, p);
+    if (off) {
+        /* store the result in destination address */
+        *dst = p;
+    } else {
+        polyad_free(p);
+    }
+    return off;
+}
+
+size_t
+polyad_load_many(const void *src, size_t len, int flags, void *mem, size_t memlen,
+        const struct polyad **dst, size_t *n)
+{
+    struct polyad *p;
+    size_t off, used, size, i;
+    off = used = 0;
+    for (i = 0; i < *n && off < len; i++) {
+        if (!polyad_load_ex((const char *) src + off, len - off, flags,
+                (char *) mem + used, memlen - used, &dst[i])) {
+            break;
+        }
+        /* a polyad is only known to be whole once sized, if lazy or trusted */
+        p = (struct polyad *) dst[i];
+        size = polyad_size_inline(p);
+        if (!size || size > len - off) {
+            if (size) {
+                errno = EINVAL;
             }
+            break;
         }
+        /* keep only the storage of the capacity this polyad needs */
+        p->capacity = polyad_capacity((const char *) src + off, len - off, p->rank);
+        used += POLYAD_SIZEOF(p->capacity);
+        off += size;
     }
+    *n = i;
     return off;
 }
 
+size_t
+polyad_reload(const void *data, size_t size, const struct polyad **dst)
+{
+    struct polyad *p, *q;
+    size_t rank, cap, n, flags;
+    p = (struct polyad *) *dst;
+    n = ntuple_rank(data, size, &rank);
+    if (!n) {
+        return 0;
+    }
+    cap = polyad_capacity(data, size, rank);
+    if (cap > POLYAD_CAPACITY_MAX) {
+        /* an untrusted rank, whose storage size would wrap */
+        errno = ENOMEM;
+        return 0;
+    }
+    if (!p || p->capacity < cap) {
+        if (p && !(p->flags & POLYAD_ALLOCATED)) {
+            errno = ENOMEM;
+            return 0;
+        }
+        /* grow geometrically, so a stream of growing ranks reallocates rarely */
+        cap = p && cap < 2 * p->capacity ? 2 * p->capacity : cap;
+        cap = cap < POLYAD_CAPACITY_MAX ? cap : POLYAD_CAPACITY_MAX;
+        flags = p ? p->flags : POLYAD_ALLOCATED;
+        q = realloc(p, POLYAD_SIZEOF(cap));
+        if (!q) {
+            return 0;
+        }
+        q->capacity = cap;
+        q->flags = flags & ~_POLYAD_INDEXED;
+        *dst = p = q;
+    }
+    return polyad_read(data, size, rank, n, p);
+}
+
 size_t
 polyad_init(size_t rank, const void **items, const size_t *sizes, const struct polyad **dst)
+{
+    return polyad_init_format(rank, items, sizes, POLYAD_FORMAT_VARINT, dst);
+}
+
+/* The worst-case header size of a polyad of rank {@code n} in a format */
+static size_t
+polyad_header_max(size_t n, int format)
+{
+    switch (format) {
+    case POLYAD_FORMAT_VARINT:
+        return NTUPLE_MAX_SIZE(n);
+    case POLYAD_FORMAT_GROUP:
+        return NTUPLE_GROUP_MAX_SIZE(n);
+    default:
+        return POLYAD_HEADER_MAX_SIZE(n);
+    }
+}
+
+/* Pack an offset table header, see POLYAD_FORMAT_INDEXED */
+static size_t
+polyad_header_indexed(size_t rank, const size_t *sizes, uint8_t *dst, size_t len)
+{
+    size_t total, off, n, w, i, j;
+    total = 0;
+    for (i = 0; i < rank; i++) {
+        total += sizes[i];
+    }
+    /* the narrowest table holding the end offset of the last item */
+    for (w = 1; w < 8 && total >> (8 * w); w <<= 1)
+        ;
+    n = size_to_vi(rank, NULL, -1);
+    if (!n) {
+        return 0;
+    }
+    if (len < 3 + n + 1 || (len - 3 - n - 1) / w <= rank) {
+        errno = EINVAL;
+        return 0;
+    }
+    memcpy(dst, "\x80\x00\x03", 3);
+    size_to_vi(rank, dst + 3, n);
+    dst[3 + n] = w;
+    dst += 3 + n + 1;
+    off = 0;
+    for (i = 0; i <= rank; i++) {
+        for (j = 0; j < w; j++) {
+            *dst++ = (uint64_t) off >> (8 * j);
+        }
+        off += i < rank ? sizes[i] : 0;
+    }
+    return 3 + n + 1 + (rank + 1) * w;
+}
+
+size_t
+polyad_header(size_t rank, const size_t *sizes, int format, void *dst, size_t len)
+{
+    switch (format) {
+    case POLYAD_FORMAT_VARINT:
+        return ntuple_pack(rank, sizes, dst, len);
+    case POLYAD_FORMAT_GROUP:
+        return ntuple_encode(rank, sizes, NTUPLE_GROUP, dst, len);
+    case POLYAD_FORMAT_INDEXED:
+        return polyad_header_indexed(rank, sizes, dst, len);
+    default:
+        errno = EINVAL;
+        return 0;
+    }
+}
+
+size_t
+polyad_iov(size_t rank, const void **items, const size_t *sizes, int format,
+        void *hdr, size_t hdrlen, struct iovec *iov)
 {
     size_t off, i;
-    struct polyad *p;
-    *dst = NULL;
-    /* calculate total header and item size */
-    off = ntuple_size(rank, sizes);
+    off = polyad_header(rank, sizes, format, hdr, hdrlen);
     if (off) {
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = off;
         for (i = 0; i < rank; i++) {
+            iov[i + 1].iov_base = (void *) items[i];
+            iov[i + 1].iov_len = sizes[i];
             off += sizes[i];
         }
-        /* allocate polyad and data buffer */
-        p = malloc(off + SIZEOF_POLYAD(rank));
-        if (p) {
-            p->rank = rank;
-            p->data = ((char *) p) + SIZEOF_POLYAD(rank);
-            off = ntuple_pack(rank, sizes, (void *)p->data, off);
-            if (off) {
-                for (i = 0; i < rank; i++) {
-                    memcpy((void *)p->data + off, items[i], sizes[i]);
+    }
+    return off;
+}
+
+size_t
+polyad_init_format(size_t rank, const void **items, const size_t *sizes,
+        int format, const struct polyad **dst)
+{
+    size_t off, cap, n, i;
+    struct polyad *p;
+    *dst = NULL;
+    /* calculate total item size, packing the header into worst-case space */
+    off = polyad_header_max(rank, format);
+    for (i = 0; i < rank; i++) {
+        off += sizes[i];
+    }
+    /* allocate polyad and data buffer, an indexed polyad with no offsets */
+    cap = format == POLYAD_FORMAT_INDEXED ? 0 : rank;
+    p = malloc(off + POLYAD_SIZEOF(cap));
+    if (p) {
+        p->rank = rank;
+        p->capacity = cap;
+        p->flags = POLYAD_ALLOCATED;
+        p->ready = rank + 1;
+        p->data = ((char *) p) + POLYAD_SIZEOF(cap);
+        off = polyad_header(rank, sizes, format, (void *)p->data, off);
+        if (off) {
+            for (i = 0; i < rank; i++) {
+                memcpy((void *)p->data + off, items[i], sizes[i]);
+                if (cap) {
                     p->item[i] = off;
-                    off += sizes[i];
                 }
+                off += sizes[i];
+            }
+            if (cap) {
                 p->item[rank] = off;
-                *dst = p;
             } else {
-                free(p);
+                /* locate the offset table, without decoding it */
+                n = ntuple_rank(p->data, off, &i);
+                off = polyad_read(p->data, off, rank, n, p);
             }
+        }
+        if (off) {
+            *dst = p;
         } else {
-            off = 0;
+            free(p);
+        }
+    } else {
+        off = 0;
+    }
+    return off;
+}
+
+/* the number of item sizes decoded at a time to locate an item */
+#define POLYAD_LOCATE 32
+
+/* The offset and size of item {@code i} below a varint header of rank {@code rank} */
+static size_t
+polyad_locate_varint(const char *src, size_t size, size_t rank, size_t n, size_t i,
+        size_t *len)
+{
+    size_t sizes[POLYAD_LOCATE];
+    size_t off, k, m, j;
+    off = 0;
+    for (k = 0; k <= i; k += m) {
+        m = rank - k < POLYAD_LOCATE ? rank - k : POLYAD_LOCATE;
+        j = vi_to_sizes(src + n, size - n, m, sizes);
+        if (!j) {
+            return 0;
+        }
+        n += j;
+        for (j = 0; j < m && k + j < i && off <= size; j++) {
+            off += sizes[j];
+        }
+        *len = i < k + m ? sizes[i - k] : 0;
+    }
+    /* the header ends after the remaining sizes */
+    if (k < rank) {
+        j = vi_span(src + n, size - n, rank - k);
+        if (!j) {
+            return 0;
+        }
+        n += j;
+    }
+    return off <= size ? n + off : 0;
+}
+
+/* The offset and size of item {@code i} below a group header of rank {@code rank} */
+static size_t
+polyad_locate_group(const char *src, size_t size, size_t rank, size_t n, size_t i,
+        size_t *len)
+{
+    size_t offsets[POLYAD_LOCATE + 1];
+    size_t end, off, k, m, j;
+    end = gvi_len(src + n, size - n, rank);
+    if (!end) {
+        return 0;
+    }
+    end += n;
+    off = end;
+    /* whole groups, up to the one of item i */
+    for (k = 0; ; k += m) {
+        m = rank - k < POLYAD_LOCATE ? rank - k : POLYAD_LOCATE;
+        j = gvi_to_offsets(src + n, end - n, m, off, offsets);
+        if (!j) {
+            return 0;
+        }
+        if (i < k + m) {
+            *len = offsets[i - k + 1] - offsets[i - k];
+            return offsets[i - k];
+        }
+        n += j;
+        off = offsets[m];
+    }
+}
+
+size_t
+polyad_locate(const void *data, size_t size, size_t i, const void **dst)
+{
+    size_t mem[POLYAD_SIZEOF(0) / sizeof(size_t)];
+    const struct polyad *p;
+    size_t rank, off, len, n;
+    *dst = NULL;
+    n = ntuple_rank(data, size, &rank);
+    if (!n) {
+        return 0;
+    }
+    if (i >= rank) {
+        errno = EINVAL;
+        return 0;
+    }
+    off = len = 0;
+    switch (ntuple_format(data, size)) {
+    case NTUPLE_FORMAT_VARINT:
+        off = polyad_locate_varint(data, size, rank, n, i, &len);
+        break;
+    case NTUPLE_FORMAT_GROUP:
+        off = polyad_locate_group(data, size, rank, n, i, &len);
+        break;
+    case NTUPLE_FORMAT_INDEXED:
+        /* the offset table is read in place */
+        if (polyad_load_into(data, size, mem, sizeof(mem), &p)) {
+            len = polyad_item_inline(p, i, dst);
+            off = (const char *) *dst - (const char *) data;
+        }
+        break;
+    default:
+        if (polyad_load(data, size, &p)) {
+            len = polyad_item_inline(p, i, dst);
+            off = *dst ? (const char *) *dst - (const char *) data : 0;
+            polyad_free(p);
+        }
+        break;
+    }
+    *dst = NULL;
+    if (!off) {
+        return 0;
+    }
+    if (off > size || len > size - off) {
+        errno = EINVAL;
+        return 0;
+    }
+    *dst = (const char *) data + off;
+    return len;
+}
+
+size_t
+polyad_span(const void *data, size_t size)
+{
+    size_t mem[POLYAD_SIZEOF(0) / sizeof(size_t)];
+    const struct polyad *p;
+    const void *item;
+    size_t rank, len;
+    if (!ntuple_rank(data, size, &rank)) {
+        return 0;
+    }
+    if (!rank) {
+        /* just a header, which a polyad of rank 0 loads in place */
+        return polyad_load_ex(data, size, POLYAD_VERIFY, mem, sizeof(mem), &p);
+    }
+    len = polyad_locate(data, size, rank - 1, &item);
+    return item ? (const char *) item - (const char *) data + len : 0;
+}
+
+size_t
+polyad_path(const void *data, size_t size, size_t depth, const size_t *path,
+        const void **dst)
+{
+    size_t i;
+    *dst = data;
+    for (i = 0; i < depth && *dst; i++) {
+        size = polyad_locate(*dst, size, path[i], dst);
+    }
+    return size;
+}
+
+int
+polyad_builder_init(struct polyad_builder *b, size_t rank, int format)
+{
+    struct polyad *p;
+    b->polyad = NULL;
+    if (format != POLYAD_FORMAT_VARINT && format != POLYAD_FORMAT_GROUP &&
+            format != POLYAD_FORMAT_INDEXED) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (rank > POLYAD_BUILDER_RANK_MAX) {
+        errno = ENOMEM;
+        return 0;
+    }
+    b->format = format;
+    b->reserve = polyad_header_max(rank, format);
+    b->alloc = POLYAD_SIZEOF(rank) + b->reserve;
+    p = malloc(b->alloc);
+    if (!p) {
+        return 0;
+    }
+    p->rank = 0;
+    p->capacity = rank;
+    p->flags = POLYAD_ALLOCATED;
+    p->item[0] = 0;
+    b->polyad = p;
+    return 1;
+}
+
+/* The start of the items appended to a builder */
+static inline char *
+polyad_builder_items(const struct polyad_builder *b)
+{
+    return (char *) b->polyad + POLYAD_SIZEOF(b->polyad->capacity) + b->reserve;
+}
+
+/* Make room in a builder for {@code rank} items and {@code size} more bytes */
+static int
+polyad_builder_grow(struct polyad_builder *b, size_t rank, size_t size)
+{
+    struct polyad *p = b->polyad;
+    const size_t used = p->item[p->rank];
+    size_t cap, reserve, need;
+    if (rank > POLYAD_BUILDER_RANK_MAX) {
+        errno = ENOMEM;
+        return 0;
+    }
+    cap = p->capacity;
+    if (rank > cap) {
+        cap = rank < 2 * cap ? 2 * cap : rank;
+        cap = cap < POLYAD_BUILDER_RANK_MAX ? cap : POLYAD_BUILDER_RANK_MAX;
+    }
+    reserve = polyad_header_max(cap, b->format);
+    need = POLYAD_SIZEOF(cap) + reserve;
+    if (used > SIZE_MAX - need || size > SIZE_MAX - need - used) {
+        errno = ENOMEM;
+        return 0;
+    }
+    need += used + size;
+    if (need > b->alloc) {
+        /* grow geometrically, so appending items reallocates rarely */
+        need = need < 2 * b->alloc ? 2 * b->alloc : need;
+        p = realloc(p, need);
+        if (!p) {
+            return 0;
+        }
+        b->polyad = p;
+        b->alloc = need;
+    }
+    if (cap > p->capacity) {
+        /* move the items behind the larger offset table and header space */
+        memmove((char *) p + POLYAD_SIZEOF(cap) + reserve,
+                polyad_builder_items(b), used);
+        p->capacity = cap;
+        b->reserve = reserve;
+    }
+    return 1;
+}
+
+void *
+polyad_builder_alloc(struct polyad_builder *b, size_t size)
+{
+    struct polyad *p;
+    size_t off;
+    if (!polyad_builder_grow(b, b->polyad->rank + 1, size)) {
+        return NULL;
+    }
+    p = b->polyad;
+    off = p->item[p->rank];
+    p->item[++p->rank] = off + size;
+    return polyad_builder_items(b) + off;
+}
+
+size_t
+polyad_builder_append(struct polyad_builder *b, const void *item, size_t size)
+{
+    void *const dst = polyad_builder_alloc(b, size);
+    if (!dst) {
+        return 0;
+    }
+    memcpy(dst, item, size);
+    return b->polyad->rank;
+}
+
+size_t
+polyad_builder_finish(struct polyad_builder *b, const struct polyad **dst)
+{
+    struct polyad *const p = b->polyad;
+    char *const base = (char *) p + POLYAD_SIZEOF(p->capacity);
+    const size_t rank = p->rank;
+    size_t off, n, s, i;
+    b->polyad = NULL;
+    *dst = NULL;
+    /* the item offsets become sizes, to pack the header at the start of
+     * its reserved space */
+    for (i = 0; i < rank; i++) {
+        p->item[i] = p->item[i + 1] - p->item[i];
+    }
+    off = polyad_header(rank, p->item, b->format, base, b->reserve);
+    if (off) {
+        /* then slide it up against the items */
+        p->data = memmove(base + b->reserve - off, base, off);
+        p->ready = rank + 1;
+        if (b->format == POLYAD_FORMAT_INDEXED) {
+            off += p->item[rank];
+            n = ntuple_rank(p->data, off, &i);
+            off = polyad_read(p->data, off, rank, n, p);
+        } else {
+            for (i = 0; i < rank; i++) {
+                s = p->item[i];
+                p->item[i] = off;
+                off += s;
+            }
+            p->item[rank] = off;
         }
     }
+    if (off) {
+        *dst = p;
+    } else {
+        free(p);
+    }
     return off;
 }
 
+void
+polyad_builder_free(struct polyad_builder *b)
+{
+    polyad_free(b->polyad);
+    b->polyad = NULL;
+}
+
 size_t
 polyad_copy(const struct polyad *src, void *dst, size_t len)
 {
@@ -172,5 +794,7 @@ polyad_copy(const struct polyad *src, void *dst, size_t len)
 void
 polyad_free(const struct polyad *p)
 {
-    free((void *) p);
+    if (p && p->flags & POLYAD_ALLOCATED) {
+        free((void *) p);
+    }
 }
@@ -22,6 +22,7 @@
 
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include "varint.h"
 
 /**
@@ -34,10 +35,41 @@ struct polyad;
  */
 typedef const struct polyad * polyad_t;
 
+/**
+ * The storage needed by {@code polyad_load_into} for a polyad of rank
+ * {@code n}, to be aligned as a {@code size_t}.
+ */
+#define POLYAD_SIZEOF(n) (sizeof(size_t) * ((n) + 7) + sizeof(void *))
+
+/**
+ * Load flags: resolve item offsets on demand.  Only the rank is decoded
+ * and the header end located when loading; the offsets of items are
+ * decoded up to the highest index accessed, caching progress in the
+ * polyad, which must then not be shared between threads.  Errors in the
+ * item sizes are reported by the accessors.
+ */
+#define POLYAD_LAZY 0x1
+
+/**
+ * Load flags: verify that every item lies within the read buffer, with
+ * the item offsets checked as they are computed from the header (and the
+ * offset table of an indexed polyad checked to be in order).  Without it,
+ * only the header is checked to lie within the buffer.  A verified polyad
+ * is not lazy, its item sizes being decoded at once.
+ */
+#define POLYAD_VERIFY 0x2
+
+/**
+ * Load flags: trust the read buffer to hold a well-formed polyad, as
+ * packed by this library, skipping the checks of item offsets that are
+ * not needed to decode the header.
+ */
+#define POLYAD_TRUST 0x4
+
 /** The number of items in a polyad. **/
 size_t polyad_rank(polyad_t p);
 
-/** The number of bytes in a polyad. **/
+/** The number of bytes in a polyad (0 if a lazy polyad's header is invalid). **/
 size_t polyad_size(polyad_t p);
 
 /** The data buffer backing the entire polyad. **/
@@ -54,6 +86,7 @@ const void * polyad_data(polyad_t p);
  *   the polyad item buffer, or NULL on error. On success, the return
  *   value will be the size of this buffer.
  * @error EINVAL {@code i} is greater or equal to the polyad rank
+ * @error ERANGE, EINVAL the header of a lazy polyad is invalid
  */
 size_t polyad_item(polyad_t p, size_t i, const void **dst);
 
@@ -73,6 +106,154 @@ size_t polyad_item(polyad_t p, size_t i, const void **dst);
  **/
 size_t polyad_load(const void *src, size_t len, polyad_t *dst);
 
+/**
+ * Initialize a polyad structure from serialized form in caller storage.
+ *
+ * As {@code polyad_load}, without allocating: the polyad is stored in
+ * {@code mem}, which must outlive it, and need not be freed.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size (maximum length of polyad)
+ * @param mem storage for the polyad, aligned as a {@code size_t}
+ * @param memlen the size of {@code mem}
+ * @param dst the address of an uninitialized polyad pointer
+ * @return the number of bytes read, 0 on error
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL the buffer {@code size} is too small to read a full polyad
+ * @error ENOMEM {@code memlen} is less than {@code POLYAD_SIZEOF} of the rank
+ **/
+size_t polyad_load_into(const void *src, size_t len, void *mem, size_t memlen, polyad_t *dst);
+
+/**
+ * The size of the storage to load a polyad into, see {@code polyad_load_into}.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size (maximum length of polyad)
+ * @return the storage size, 0 on error
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL the buffer does not hold a polyad header
+ * @error ENOMEM the rank is too large to be stored
+ **/
+size_t polyad_sizeof(const void *src, size_t len);
+
+/**
+ * Initialize a polyad structure from serialized form, with load flags.
+ *
+ * The general form of {@code polyad_load} (when {@code mem} is NULL) and
+ * {@code polyad_load_into}.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size (maximum length of polyad)
+ * @param flags the load flags, {@code POLYAD_LAZY} and either
+ *              {@code POLYAD_VERIFY} or {@code POLYAD_TRUST}, or 0
+ * @param mem storage for the polyad, or NULL to allocate it
+ * @param memlen the size of {@code mem}
+ * @param dst the address of an uninitialized polyad pointer
+ * @return the number of bytes read, 0 on error: with {@code POLYAD_LAZY},
+ *         only the header is read
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL the buffer {@code size} is too small to read a full polyad,
+ *               an item does not lie within it when verified, or both
+ *               {@code POLYAD_VERIFY} and {@code POLYAD_TRUST} are given
+ * @error ENOMEM memory allocation failure, or {@code memlen} is too small
+ **/
+size_t polyad_load_ex(const void *src, size_t len, int flags, void *mem, size_t memlen,
+        polyad_t *dst);
+
+/**
+ * Load consecutive polyads from a buffer into one block of storage.
+ *
+ * Each polyad takes {@code POLYAD_SIZEOF} of its capacity from {@code mem}
+ * in turn, and is freed with it rather than by {@code polyad_free}.
+ * Loading stops after {@code *n} polyads, at the end of the buffer, or at
+ * the first polyad that is not loaded, such as one cut short at the end
+ * of a stream, or one that does not fit in the storage left (ENOMEM).
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size
+ * @param flags the load flags (see {@code polyad_load_ex})
+ * @param mem storage for the polyads
+ * @param memlen the size of {@code mem}
+ * @param dst an array of {@code *n} polyad pointers to store
+ * @param n the address of the greatest number of polyads to load, set to
+ *          the number loaded
+ * @return the number of bytes of the polyads loaded, from which to
+ *         resume; errno is set when loading stopped at a polyad
+ **/
+size_t polyad_load_many(const void *src, size_t len, int flags, void *mem, size_t memlen,
+        polyad_t *dst, size_t *n);
+
+/**
+ * Reload a polyad structure from serialized form, reusing its storage.
+ *
+ * The polyad at {@code *p} (or NULL, to allocate one) is overwritten in
+ * place when its capacity holds the new rank, so that parsing a stream of
+ * polyads allocates only while the rank grows.  Otherwise a polyad from
+ * {@code polyad_load} or {@code polyad_reload} is reallocated, and one in
+ * caller storage fails with ENOMEM.  The load flags of {@code *p} are
+ * kept (none for a new polyad).  On error, {@code *p} remains valid
+ * to be reloaded or freed, but its contents are unspecified.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size (maximum length of polyad)
+ * @param p the address of a polyad pointer to reuse and update
+ * @return the number of bytes read, 0 on error
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL the buffer {@code size} is too small to read a full polyad
+ * @error ENOMEM memory allocation failure
+ **/
+size_t polyad_reload(const void *src, size_t len, polyad_t *p);
+
+/**
+ * Locate an item of a polyad in serialized form, without loading it.
+ *
+ * Only the item sizes up to item {@code i} are decoded (none, for an
+ * indexed polyad), on the stack; a polyad with an ntuple header in
+ * another packed format (see {@code ntuple_encode}) is loaded.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size (maximum length of polyad)
+ * @param i the item index
+ * @param dst the address of a memory address
+ * @return
+ *   The address at {@code dst} will contain a pointer to the start of
+ *   the item buffer, or NULL on error. On success, the return value will
+ *   be the size of this buffer.
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL {@code i} is greater or equal to the polyad rank, or the
+ *               item does not lie within {@code len}
+ * @error ENOMEM memory allocation failure, for another packed format
+ */
+size_t polyad_locate(const void *src, size_t len, size_t i, const void **dst);
+
+/**
+ * The size of a polyad in serialized form, without loading it: as
+ * {@code polyad_locate} of its last item, which must lie within {@code len}.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size (maximum length of polyad)
+ * @return the size of the polyad, 0 on error
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL the buffer {@code size} is too small to hold the polyad
+ * @error ENOMEM memory allocation failure, for another packed format
+ */
+size_t polyad_span(const void *src, size_t len);
+
+/**
+ * Locate an item of nested polyads in serialized form, without loading
+ * them: {@code path} indexes an item of the polyad at {@code src}, then
+ * an item of that item as a polyad, and so on.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size (maximum length of polyad)
+ * @param depth the length of {@code path}
+ * @param path the item index at each level
+ * @param dst the address of a memory address
+ * @return the size of the final item, see {@code polyad_locate}
+ */
+size_t polyad_path(const void *src, size_t len, size_t depth, const size_t *path,
+        const void **dst);
+
 /**
  * Allocate and initialize a new polyad structure from items.
  *
@@ -89,6 +270,145 @@ size_t polyad_load(const void *src, size_t len, polyad_t *dst);
  */
 size_t polyad_init(size_t rank, const void **items, const size_t *sizes, polyad_t *dst);
 
+/** Header formats: item sizes as 7-bit varints (the default) **/
+#define POLYAD_FORMAT_VARINT 0
+/** Header formats: item sizes as group varints, located four at a time **/
+#define POLYAD_FORMAT_GROUP 1
+/**
+ * Header formats: a table of item offsets, each 1, 2, 4 or 8 bytes wide
+ * as the total item size requires, so any item is located in constant
+ * time.  An indexed polyad is loaded without decoding its offsets, into
+ * {@code POLYAD_SIZEOF(0)} bytes whatever its rank.
+ */
+#define POLYAD_FORMAT_INDEXED 2
+
+/** The worst-case header size of a polyad of rank {@code n}, in any format **/
+#define POLYAD_HEADER_MAX_SIZE(n) \
+    (3 + VI_MAX_LEN + 1 + ((n) + 3) / 4 + 8 * ((n) + 1))
+
+/**
+ * Pack just the header of a polyad, for items written separately after it.
+ *
+ * @param rank the number of items in the polyad
+ * @param sizes the size of each item
+ * @param format the header format, see {@code polyad_init_format}
+ * @param dst the destination buffer
+ * @param len the size of the destination buffer, at most
+ *            {@code POLYAD_HEADER_MAX_SIZE(rank)} bytes are written
+ * @return the number of bytes written to {@code dst}, 0 on error
+ * @error ERANGE a {@code size_t} value would overflow when stored as a varint
+ * @error EINVAL {@code len} is too small, or {@code format} is unknown
+ */
+size_t polyad_header(size_t rank, const size_t *sizes, int format, void *dst, size_t len);
+
+/**
+ * Describe a polyad as an I/O vector without copying its items.
+ *
+ * The header is packed into {@code hdr}, and {@code iov} filled with the
+ * header followed by each item buffer, as written by {@code writev(2)} or
+ * {@code sendmsg(2)} (which take at most {@code IOV_MAX} vectors a call).
+ *
+ * @param rank the number of items in the polyad
+ * @param items an array of {@code rank} item buffers
+ * @param sizes the size of each corresponding buffer in {@code items}
+ * @param format the header format, see {@code polyad_init_format}
+ * @param hdr the header buffer, which must outlive {@code iov}
+ * @param hdrlen the size of {@code hdr}, see {@code polyad_header}
+ * @param iov an array of {@code rank + 1} I/O vectors
+ * @return the total size of the polyad, 0 on error
+ * @error ERANGE a {@code size_t} value would overflow when stored as a varint
+ * @error EINVAL {@code hdrlen} is too small, or {@code format} is unknown
+ */
+size_t polyad_iov(size_t rank, const void **items, const size_t *sizes, int format,
+        void *hdr, size_t hdrlen, struct iovec *iov);
+
+/**
+ * Allocate and initialize a new polyad structure from items, with the
+ * header in the given format.  {@code polyad_load} detects the format.
+ *
+ * @param rank the number of items in the polyad
+ * @param items an array of {@code rank} item buffers
+ * @param sizes the size of each corresponding buffer in {@code items}
+ * @param format the header format, {@code POLYAD_FORMAT_VARINT},
+ *               {@code POLYAD_FORMAT_GROUP} or {@code POLYAD_FORMAT_INDEXED}
+ * @param dst the address of an uninitialized polyad pointer
+ * @return the size of the polyad data buffer, 0 on error
+ * @error ERANGE a {@code size_t} value would overflow when stored as a varint
+ * @error EINVAL {@code format} is unknown
+ * @error ENOMEM memory allocation failure
+ */
+size_t polyad_init_format(size_t rank, const void **items, const size_t *sizes,
+        int format, polyad_t *dst);
+
+/**
+ * An incremental polyad builder.  Items are appended in place to a single
+ * allocation behind worst-case header space, which the header is packed
+ * into when the polyad is finished, so that items need not be gathered
+ * before packing.
+ */
+struct polyad_builder {
+    /* the polyad under construction, holding the appended item offsets */
+    struct polyad *polyad;
+    /* the header space reserved ahead of the items */
+    size_t reserve;
+    /* the size of the allocation */
+    size_t alloc;
+    int format;
+};
+
+/**
+ * Initialize a polyad builder, reserving header space for an expected rank.
+ *
+ * Appending more than {@code rank} items is allowed, but moves the items
+ * already appended to reserve more header space.
+ *
+ * @param b the builder
+ * @param rank the expected number of items, or 0 if unknown
+ * @param format the header format, see {@code polyad_init_format}
+ * @return 1 on success, 0 on error
+ * @error EINVAL {@code format} is unknown
+ * @error ENOMEM memory allocation failure, or {@code rank} is too large
+ */
+int    polyad_builder_init(struct polyad_builder *b, size_t rank, int format);
+
+/**
+ * Append an item to a polyad builder, to be written by the caller.
+ *
+ * @param b the builder
+ * @param size the size of the item
+ * @return the address of the item buffer, valid until the next item is
+ *         appended, or NULL on error
+ * @error ENOMEM memory allocation failure
+ */
+void * polyad_builder_alloc(struct polyad_builder *b, size_t size);
+
+/**
+ * Append a copy of an item to a polyad builder.
+ *
+ * @param b the builder
+ * @param item the item buffer
+ * @param size the size of the item buffer
+ * @return the number of items appended (always > 0), or 0 on error
+ * @error ENOMEM memory allocation failure
+ */
+size_t polyad_builder_append(struct polyad_builder *b, const void *item, size_t size);
+
+/**
+ * Pack the header of a built polyad in front of its items.  The builder
+ * is released, whether or not this succeeds.
+ *
+ * @param b the builder
+ * @param dst the address of an uninitialized polyad pointer
+ * @return the size of the polyad data buffer, 0 on error
+ * @error ERANGE a {@code size_t} value would overflow when stored as a varint
+ */
+size_t polyad_builder_finish(struct polyad_builder *b, polyad_t *dst);
+
+/**
+ * Release a polyad builder without finishing it.
+ **/
+void   polyad_builder_free(struct polyad_builder *b);
+
 /**
  * Copy a polyad into another data buffer.
  *
@@ -101,7 +421,8 @@ size_t polyad_init(size_t rank, const void **items, const size_t *sizes, polyad_
 size_t polyad_copy(polyad_t src, void *dst, size_t len);
 
 /**
- * Free the memory associated with a polyad.
+ * Free the memory associated with a polyad (none, for a polyad in caller
+ * storage from {@code polyad_load_into}).
  **/
 void   polyad_free(polyad_t p);
 
@@ -0,0 +1,290 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _polyadicts_inline_h_DEFINED
+#define _polyadicts_inline_h_DEFINED
+
+/**
+ * Header-only inline varint, ntuple and polyad accessors.
+ *
+ * Each {@code *_inline} function has the same semantics as its
+ * out-of-line counterpart, but may be inlined and specialized by the
+ * compiler of the including file (e.g. using {@code pext} when built
+ * with {@code -mbmi2}).  The polyad accessors operate on polyads from
+ * the out-of-line API, whose structure is defined here for that purpose.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "varint.h"
+
+#if SIZE_MAX == UINT64_MAX && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define VI_LE64 1
+#endif
+
+#if defined(__BMI2__) && defined(VI_LE64)
+#include <immintrin.h>
+#endif
+
+struct polyad {
+    size_t rank;
+    /* the greatest rank the storage of this struct can hold */
+    size_t capacity;
+    /* load flags and internal state, see polyad.c */
+    size_t flags;
+    /* the number of leading item offsets resolved, all unless lazy */
+    size_t ready;
+    /* the header offset of the next item size to resolve, or of the
+     * offset table of an indexed polyad */
+    size_t next;
+    /* the offset table entry width of an indexed polyad */
+    size_t width;
+    void * data;
+    size_t item[];
+};
+
+/* flags: the polyad has an offset table, and only item[0] (its data start) */
+#define _POLYAD_INDEXED 0x200
+
+/* Resolve the offsets of a lazily loaded polyad up to {@code item[i]} */
+int _polyad_resolve(const struct polyad *p, size_t i);
+
+static inline uint64_t
+_vi_load64(const void *src)
+{
+    uint64_t x;
+    memcpy(&x, src, sizeof(x));
+    return x;
+}
+
+/*
+ * Gather the low 7 bits of the first {@code n} (1 to 8) little-endian
+ * bytes of {@code x} into a contiguous value.
+ */
+static inline uint64_t
+_vi_gather(uint64_t x, unsigned n)
+{
+    x &= 0x7f7f7f7f7f7f7f7fULL >> (64 - 8 * n);
+#if defined(__BMI2__) && defined(VI_LE64)
+    return _pext_u64(x, 0x7f7f7f7f7f7f7f7fULL);
+#else
+    x = (x & 0x007f007f007f007fULL) | ((x & 0x7f007f007f007f00ULL) >> 1);
+    x = (x & 0x00003fff00003fffULL) | ((x & 0x3fff00003fff0000ULL) >> 2);
+    x = (x & 0x000000000fffffffULL) | ((x & 0x0fffffff00000000ULL) >> 4);
+    return x;
+#endif
+}
+
+/*
+ * Spread the low 56 bits of {@code x} into the low 7 bits of each of the
+ * 8 little-endian bytes of the result (the inverse of _vi_gather).
+ */
+static inline uint64_t
+_vi_scatter(uint64_t x)
+{
+#if defined(__BMI2__) && defined(VI_LE64)
+    return _pdep_u64(x, 0x7f7f7f7f7f7f7f7fULL);
+#else
+    x = (x & 0x000000000fffffffULL) | ((x & 0x00fffffff0000000ULL) << 4);
+    x = (x & 0x00003fff00003fffULL) | ((x & 0x0fffc0000fffc000ULL) << 2);
+    x = (x & 0x007f007f007f007fULL) | ((x & 0x3f803f803f803f80ULL) << 1);
+    return x;
+#endif
+}
+
+/* The length of {@code x} as a varint, which must not exceed VI_MAX */
+static inline unsigned
+_vi_len(uint64_t x)
+{
+    return (64 - __builtin_clzll(x | 1) + 6) / 7;
+}
+
+/* Read a varint, checking the buffer and varint limits at every byte */
+static inline size_t
+_vi_to_size_checked(const void *const src, size_t len, size_t *dst)
+{
+    const uint8_t *const v = src;
+    size_t x, i;
+    x = i = 0;
+    for (;;) {
+        if (i == len) {
+            errno = EINVAL;
+            return 0;
+        } else if (i == VI_MAX_LEN) {
+            errno = ERANGE;
+            return 0;
+        } else {
+            x |= (v[i] & 0x7fLL) << (7 * i);
+            if (!(v[i++] & 0x80)) {
+                *dst = x;
+                return i;
+            }
+        }
+    }
+}
+
+/** @see vi_to_size **/
+static inline size_t
+vi_to_size_inline(const void *const src, size_t len, size_t *dst)
+{
+#ifdef VI_LE64
+    /*
+     * With more than VI_MAX_LEN readable bytes, locate the terminator
+     * within one unaligned load instead of testing each byte.
+     */
+    const uint8_t *const v = src;
+    uint64_t x, ends;
+    size_t n;
+    if (len > VI_MAX_LEN) {
+        x = _vi_load64(v);
+        ends = ~x & 0x8080808080808080ULL;
+        if (ends) {
+            n = __builtin_ctzll(ends) / 8 + 1;
+            *dst = _vi_gather(x, n);
+            return n;
+        } else if (!(v[8] & 0x80)) {
+            *dst = _vi_gather(x, 8) | ((uint64_t)v[8] << 56);
+            return VI_MAX_LEN;
+        } else {
+            errno = ERANGE;
+            return 0;
+        }
+    }
+#endif
+    return _vi_to_size_checked(src, len, dst);
+}
+
+/** @see size_to_vi **/
+static inline size_t
+size_to_vi_inline(size_t x, void *const dst, size_t len)
+{
+    uint8_t *const v = dst;
+    size_t s, i;
+    if (x > VI_MAX) {
+        errno = ERANGE;
+        return 0;
+    }
+    s = _vi_len(x);
+    if (s > len) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (v) {
+        for (i = 0; i < s - 1; i++, x >>= 7) {
+            v[i] = (x & 0x7f) | 0x80;
+        }
+        v[i] = (x & 0x7f);
+    }
+    return s;
+}
+
+/** @see ntuple_rank **/
+static inline size_t
+ntuple_rank_inline(const void *data, size_t size, size_t *rank)
+{
+    const uint8_t *const v = data;
+    size_t n;
+    if (size >= 2 && v[0] == 0x80 && v[1] == 0) {
+        /* an extended header: bit-packed (1), group varint (2) or indexed (3) */
+        if (size < 3 || v[2] < 1 || v[2] > 3) {
+            errno = EINVAL;
+            return 0;
+        }
+        n = vi_to_size_inline(v + 3, size - 3, rank);
+        return n ? n + 3 : 0;
+    }
+    return vi_to_size_inline(data, size, rank);
+}
+
+/* The offset of item {@code i} (or the end, for the rank) of an indexed polyad */
+static inline size_t
+_polyad_offset(const struct polyad *p, size_t i)
+{
+    const uint8_t *const t = (const uint8_t *) p->data + p->next + i * p->width;
+    uint64_t x;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint8_t b;
+    uint16_t h;
+    uint32_t w;
+    switch (p->width) {
+    case 1: memcpy(&b, t, 1); x = b; break;
+    case 2: memcpy(&h, t, 2); x = h; break;
+    case 4: memcpy(&w, t, 4); x = w; break;
+    default: memcpy(&x, t, 8); break;
+    }
+#else
+    size_t j;
+    for (x = 0, j = p->width; j--; ) {
+        x = x << 8 | t[j];
+    }
+#endif
+    return p->item[0] + x;
+}
+
+/** @see polyad_rank **/
+static inline size_t
+polyad_rank_inline(const struct polyad *p)
+{
+    return p->rank;
+}
+
+/** @see polyad_size **/
+static inline size_t
+polyad_size_inline(const struct polyad *p)
+{
+    if (p->flags & _POLYAD_INDEXED)
+        return _polyad_offset(p, p->rank);
+    if (p->ready <= p->rank && !_polyad_resolve(p, p->rank))
+        return 0;
+    return p->item[p->rank];
+}
+
+/** @see polyad_data **/
+static inline const void *
+polyad_data_inline(const struct polyad *p)
+{
+    return p->data;
+}
+
+/** @see polyad_item **/
+static inline size_t
+polyad_item_inline(const struct polyad *p, size_t i, const void **item)
+{
+    size_t start;
+    if (i < p->rank) {
+        if (p->flags & _POLYAD_INDEXED) {
+            start = _polyad_offset(p, i);
+            *item = ((const char *) p->data) + start;
+            return _polyad_offset(p, i + 1) - start;
+        }
+        if (p->ready <= i + 1 && !_polyad_resolve(p, i + 1)) {
+            *item = NULL;
+            return 0;
+        }
+        *item = ((const char *) p->data) + p->item[i];
+        return p->item[i + 1] - p->item[i];
+    } else {
+        *item = NULL;
+        errno = EINVAL;
+        return 0;
+    }
+}
+
+#endif /* _polyadicts_inline_h_DEFINED */
@@ -19,29 +19,160 @@
 
 #include "polyadictsmodule.h"
 #include "polyadobject.h"
+#include "polyfileobject.h"
+#include "polyloaderobject.h"
+#include "polylogobject.h"
 #include "ntuple.h"
+#include "varint.h"
 #include "varyadobject.h"
+#include "zigzag.h"
+
+/* Parse the keyword-only options of a METH_VARARGS function */
+static int
+_parse_options(PyObject *kwds, const char *format, char **kwlist, ...)
+{
+    va_list va;
+    PyObject *empty;
+    int ok;
+    if (!kwds)
+        return 1;
+    empty = PyTuple_New(0);
+    if (!empty)
+        return 0;
+    va_start(va, kwlist);
+    ok = PyArg_VaParseTupleAndKeywords(empty, kwds, format, kwlist, va);
+    va_end(va);
+    Py_DECREF(empty);
+    return ok;
+}
+
+/* Whether a buffer holds native 8-byte integers, e.g. array('Q') */
+static int
+_typed_buffer(const Py_buffer *view)
+{
+    const char *f = view->format;
+    if (!f || view->itemsize != sizeof(uint64_t))
+        return 0;
+    if (*f == '@' || *f == '=')
+        f++;
+    return f[0] && strchr("QqLlNn", f[0]) && !f[1];
+}
+
+/* A new zeroed array of {@code n} 8-byte integers of the given typecode */
+static PyObject *
+_new_array(const char *typecode, size_t n)
+{
+    static PyObject *array_type = NULL;
+    PyObject *mod, *zero, *proto, *ret;
+    if (!array_type) {
+        mod = PyImport_ImportModule("array");
+        if (!mod)
+            return NULL;
+        array_type = PyObject_GetAttrString(mod, "array");
+        Py_DECREF(mod);
+        if (!array_type)
+            return NULL;
+    }
+    ret = NULL;
+    zero = PyBytes_FromStringAndSize("\0\0\0\0\0\0\0\0", sizeof(uint64_t));
+    if (zero) {
+        proto = PyObject_CallFunction(array_type, "sO", typecode, zero);
+        if (proto) {
+            ret = PySequence_Repeat(proto, n);
+            Py_DECREF(proto);
+        }
+        Py_DECREF(zero);
+    }
+    return ret;
+}
+
+/* Pack an ntuple into a new bytes object */
+static PyObject *
+_ntuple_pack(size_t rank, const uint64_t *info, int flags)
+{
+    const size_t max = flags & NTUPLE_BITPACK ? NTUPLE_BITPACK_MAX_SIZE(rank) :
+            flags & NTUPLE_GROUP ? NTUPLE_GROUP_MAX_SIZE(rank) : NTUPLE_MAX_SIZE(rank);
+    PyObject *ret;
+    size_t size;
+    ret = PyBytes_FromStringAndSize(NULL, max);
+    if (ret) {
+        PyPolyad_BEGIN_ALLOW_THREADS(rank * sizeof(uint64_t))
+        size = ntuple_encode(rank, info, flags, PyBytes_AS_STRING(ret), max);
+        PyPolyad_END_ALLOW_THREADS
+        if (size) {
+            _PyBytes_Resize(&ret, size);
+        } else {
+            Py_CLEAR(ret);
+            PyPolyad_SetErrFromErrno();
+        }
+    }
+    return ret;
+}
+
+/* Load an ntuple into a writable buffer of 8-byte integers */
+static PyObject *
+_ntuple_loadinto(Py_buffer *view, size_t rank, PyObject *out, int flags)
+{
+    Py_buffer dst;
+    size_t size;
+    PyObject *ret;
+
+    ret = NULL;
+    if (0 == PyObject_GetBuffer(out, &dst, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS)) {
+        if (dst.len / sizeof(uint64_t) >= rank) {
+            PyPolyad_BEGIN_ALLOW_THREADS(view->len)
+            size = ntuple_decode(view->buf, view->len, flags, rank, dst.buf);
+            PyPolyad_END_ALLOW_THREADS
+            if ((Py_ssize_t) size == view->len) {
+                ret = PyLong_FromSize_t(rank);
+            } else if (size) {
+                PyErr_SetString(PyExc_ValueError, "buffer contains trailing data");
+            } else {
+                PyPolyad_SetErrFromErrno();
+            }
+        } else {
+            PyErr_SetString(PyExc_ValueError, "output buffer is too small");
+        }
+        PyBuffer_Release(&dst);
+    }
+    return ret;
+}
 
 static PyObject*
-_ntuple_frombuffer(PyObject *src)
+_ntuple_frombuffer(Py_buffer *view, PyObject *out, int array, int flags)
 {
-    Py_buffer view;
     size_t rank, size, i;
     uint64_t *info;
-    PyObject *ret;
+    PyObject *ret, *tmp;
 
     ret = NULL;
-    if (0 == PyObject_GetBuffer(src, &view, PyBUF_SIMPLE)) {
-        if (ntuple_rank(view.buf, view.len, &rank)) {
+    if (ntuple_rank(view->buf, view->len, &rank)) {
+        if (out) {
+            ret = _ntuple_loadinto(view, rank, out, flags);
+        } else if (array) {
+            ret = _new_array(flags & NTUPLE_ZIGZAG ? "q" : "Q", rank);
+            if (ret) {
+                tmp = _ntuple_loadinto(view, rank, ret, flags);
+                if (tmp) {
+                    Py_DECREF(tmp);
+                } else {
+                    Py_CLEAR(ret);
+                }
+            }
+        } else {
             info = malloc(rank * sizeof(uint64_t));
             if (info) {
-                size = ntuple_load(view.buf, view.len, rank, info);
+                PyPolyad_BEGIN_ALLOW_THREADS(view->len)
+                size = ntuple_decode(view->buf, view->len, flags, rank, info);
+                PyPolyad_END_ALLOW_THREADS
                 if (size) {
-                    if (size == view.len) {
+                    if ((Py_ssize_t) size == view->len) {
                         ret = PyTuple_New(rank);
                         if (ret) {
                             for (i = 0; i < rank; i++) {
-                                PyTuple_SET_ITEM(ret, i, PyLong_FromUnsignedLongLong(info[i]));
+                                PyTuple_SET_ITEM(ret, i, flags & NTUPLE_ZIGZAG ?
+                                        PyLong_FromLongLong(info[i]) :
+                                        PyLong_FromUnsignedLongLong(info[i]));
                             }
                         }
                     } else {
@@ -59,11 +190,10 @@ _ntuple_frombuffer(PyObject *src)
 }
 
 static PyObject *
-_ntuple_fromsequence(PyObject *src)
+_ntuple_fromsequence(PyObject *src, int flags)
 {
     uint64_t *info;
-    size_t i, rank, size;
-    void *data;
+    size_t i, rank;
     PyObject *ret, *obj;
 
     src = PySequence_Fast(src, "expected a sequence of natural numbers");
@@ -82,21 +212,17 @@ _ntuple_fromsequence(PyObject *src)
     if (info) {
         for (i = 0; i < rank; i++) {
             obj = PySequence_Fast_GET_ITEM(src, i);
-            info[i] = PyLong_AsUnsignedLongLong(obj);
+            if (flags & NTUPLE_ZIGZAG) {
+                info[i] = PyLong_AsLongLong(obj);
+            } else {
+                info[i] = PyLong_AsUnsignedLongLong(obj);
+            }
             if (PyErr_Occurred()) {
                 break;
             }
         }
         if (i == rank) {
-            size = ntuple_size(rank, info);
-            if (size) {
-                data = malloc(size);
-                if (data) {
-                    ntuple_pack(rank, info, data, size);
-                    ret = PyBytes_FromStringAndSize(data, size);
-                    free(data);
-                }
-            }
+            ret = _ntuple_pack(rank, info, flags);
         }
         free(info);
     }
@@ -105,33 +231,126 @@ _ntuple_fromsequence(PyObject *src)
 }
 
 static PyObject *
-polyadicts_ntuple(PyObject *self, PyObject *args)
+polyadicts_ntuple(PyObject *self, PyObject *args, PyObject *kwds)
 {
+    static char *kwlist[] = {"out", "array", "zigzag", "delta", "bitpack", "group", NULL};
+    static const int deltas[] = {0, NTUPLE_DELTA, NTUPLE_DELTA2};
     Py_ssize_t rank;
-    PyObject *ret, *arg;
+    Py_buffer view;
+    PyObject *ret, *arg, *out;
+    int array, zigzag, delta, bitpack, group, flags;
+
+    out = NULL;
+    array = zigzag = delta = bitpack = group = 0;
+    if (!_parse_options(kwds, "|$Oppipp:ntuple", kwlist,
+            &out, &array, &zigzag, &delta, &bitpack, &group))
+        return NULL;
+    if (delta < 0 || delta > 2) {
+        PyErr_SetString(PyExc_ValueError, "delta must be 0, 1 or 2");
+        return NULL;
+    }
+    flags = (zigzag ? NTUPLE_ZIGZAG : 0) | (bitpack ? NTUPLE_BITPACK : 0) |
+            (group ? NTUPLE_GROUP : 0) | deltas[delta];
 
     ret = NULL;
     rank = PyTuple_GET_SIZE(args);
-    if (rank == 1) {
+    if (rank == 1 && PyObject_CheckBuffer(PyTuple_GET_ITEM(args, 0))) {
         arg = PyTuple_GET_ITEM(args, 0);
-        if (PyObject_CheckBuffer(arg)) {
-            ret = _ntuple_frombuffer(arg);
-        } else if (PySequence_Check(arg)) {
-            ret = _ntuple_fromsequence(arg);
-        } else {
-            ret = _ntuple_fromsequence(args);
+        if (0 == PyObject_GetBuffer(arg, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS)) {
+            if (!_typed_buffer(&view)) {
+                ret = _ntuple_frombuffer(&view, out, array, flags);
+            } else if (!out && !array) {
+                ret = _ntuple_pack(view.len / sizeof(uint64_t), view.buf, flags);
+            } else {
+                PyErr_SetString(PyExc_TypeError, "out and array only apply when loading");
+            }
+            PyBuffer_Release(&view);
         }
+    } else if (out || array) {
+        PyErr_SetString(PyExc_TypeError, "out and array only apply when loading");
+    } else if (rank == 1 && PySequence_Check(PyTuple_GET_ITEM(args, 0))) {
+        ret = _ntuple_fromsequence(PyTuple_GET_ITEM(args, 0), flags);
     } else {
-        ret = _ntuple_fromsequence(args);
+        ret = _ntuple_fromsequence(args, flags);
     }
     return ret;
 }
 
-static inline
-unsigned PY_LONG_LONG
-_zig(PY_LONG_LONG n)
+/* ZigZag transform a typed buffer into {@code out}, or a new array */
+static PyObject *
+_zigzag_buffer(Py_buffer *view, PyObject *out, int zag)
 {
-    return (n << 1) ^ (n >> (8 * sizeof(PY_LONG_LONG) - 1));
+    const size_t n = view->len / sizeof(uint64_t);
+    Py_buffer dst;
+    PyObject *ret;
+
+    if (out) {
+        Py_INCREF(out);
+        ret = out;
+    } else {
+        ret = _new_array(zag ? "q" : "Q", n);
+        if (!ret)
+            return NULL;
+    }
+    if (0 == PyObject_GetBuffer(ret, &dst, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS)) {
+        if (dst.len / sizeof(uint64_t) >= n) {
+            if (zag) {
+                zag64_array(n, view->buf, dst.buf);
+            } else {
+                zig64_array(n, view->buf, dst.buf);
+            }
+        } else {
+            PyErr_SetString(PyExc_ValueError, "output buffer is too small");
+        }
+        PyBuffer_Release(&dst);
+    }
+    if (PyErr_Occurred()) {
+        Py_CLEAR(ret);
+    }
+    return ret;
+}
+
+/* ZigZag transform the arguments of zig() or zag() */
+static PyObject *
+_zigzag(PyObject *args, PyObject *kwds, int zag,
+        PyObject *(*sequence)(PyObject *), PyObject *(*object)(PyObject *))
+{
+    static char *kwlist[] = {"out", NULL};
+    Py_buffer view;
+    PyObject *arg, *out, *ret;
+
+    out = NULL;
+    if (!_parse_options(kwds, zag ? "|$O:zag" : "|$O:zig", kwlist, &out))
+        return NULL;
+
+    if (PyTuple_Size(args) == 1 && PyObject_CheckBuffer(PyTuple_GET_ITEM(args, 0))) {
+        arg = PyTuple_GET_ITEM(args, 0);
+        if (0 == PyObject_GetBuffer(arg, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS)) {
+            ret = NULL;
+            if (_typed_buffer(&view)) {
+                ret = _zigzag_buffer(&view, out, zag);
+            } else if (!out) {
+                ret = sequence(arg);
+            } else {
+                PyErr_SetString(PyExc_TypeError, "out only applies to 8-byte integer buffers");
+            }
+            PyBuffer_Release(&view);
+            return ret;
+        }
+        return NULL;
+    } else if (out) {
+        PyErr_SetString(PyExc_TypeError, "out only applies to 8-byte integer buffers");
+        return NULL;
+    } else if (PyTuple_Size(args) != 1) {
+        return sequence(args);
+    } else {
+        arg = PyTuple_GET_ITEM(args, 0);
+        if (PySequence_Check(arg)) {
+            return sequence(arg);
+        } else {
+            return object(arg);
+        }
+    }
 }
 
 static inline
@@ -140,7 +359,7 @@ _zig_object(PyObject *arg)
 {
     const PY_LONG_LONG n = PyLong_AsLongLong(arg);
     if (!PyErr_Occurred()) {
-        return PyLong_FromUnsignedLongLong(_zig(n));
+        return PyLong_FromUnsignedLongLong(zig64(n));
     } else {
         return NULL;
     }
@@ -175,25 +394,9 @@ _zig_sequence(PyObject *arg)
 }
 
 static PyObject *
-polyadicts_zig(PyObject *self, PyObject *arg)
+polyadicts_zig(PyObject *self, PyObject *args, PyObject *kwds)
 {
-    if (PyTuple_Size(arg) != 1) {
-        return _zig_sequence(arg);
-    } else {
-        arg = PyTuple_GET_ITEM(arg, 0);
-        if (PySequence_Check(arg)) {
-            return _zig_sequence(arg);
-        } else {
-            return _zig_object(arg);
-        }
-    }
-}
-
-static inline
-PY_LONG_LONG
-_zag(unsigned PY_LONG_LONG n)
-{
-    return (n >> 1) ^ -(n & 1);
+    return _zigzag(args, kwds, 0, _zig_sequence, _zig_object);
 }
 
 static inline
@@ -202,7 +405,7 @@ _zag_object(PyObject *arg)
 {
     const unsigned PY_LONG_LONG n = PyLong_AsUnsignedLongLong(arg);
     if (!PyErr_Occurred()) {
-        return PyLong_FromLongLong(_zag(n));
+        return PyLong_FromLongLong(zag64(n));
     } else {
         return NULL;
     }
@@ -237,34 +440,81 @@ _zag_sequence(PyObject *arg)
 }
 
 static PyObject *
-polyadicts_zag(PyObject *self, PyObject *arg)
+polyadicts_zag(PyObject *self, PyObject *args, PyObject *kwds)
 {
-    if (PyTuple_Size(arg) != 1) {
-        return _zag_sequence(arg);
-    } else {
-        arg = PyTuple_GET_ITEM(arg, 0);
-        if (PySequence_Check(arg)) {
-            return _zag_sequence(arg);
-        } else {
-            return _zag_object(arg);
-        }
+    return _zigzag(args, kwds, 1, _zag_sequence, _zag_object);
+}
+
+/* Parse the source and load flags of load_many and iter_load */
+static PyObject *
+_polyloader_args(PyObject *args, PyObject *kwds, const char *format)
+{
+    static char *kwlist[] = {"", "lazy", "verify", "trust", NULL};
+    PyObject *src;
+    int lazy = 0, verify = 0, trust = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, format, kwlist,
+            &src, &lazy, &verify, &trust))
+        return NULL;
+    return PyPolyloader_New(src, (lazy ? POLYAD_LAZY : 0) |
+            (verify ? POLYAD_VERIFY : 0) | (trust ? POLYAD_TRUST : 0));
+}
+
+static PyObject *
+polyadicts_iter_load(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    return _polyloader_args(args, kwds, "O|$ppp:iter_load");
+}
+
+static PyObject *
+polyadicts_load_many(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *loader, *list, *ret;
+    loader = _polyloader_args(args, kwds, "O|$ppp:load_many");
+    if (!loader)
+        return NULL;
+    ret = NULL;
+    list = PySequence_List(loader);
+    if (list) {
+        ret = Py_BuildValue("Nn", list, (Py_ssize_t) ((PyPolyloader*)loader)->offset);
     }
+    Py_DECREF(loader);
+    return ret;
 }
 
 /* polyadicts module method defition */
 static PyMethodDef polyadicts_methods[] = {
-    {"ntuple", polyadicts_ntuple, METH_VARARGS,
+    {"ntuple", (PyCFunction)polyadicts_ntuple, METH_VARARGS | METH_KEYWORDS,
         "Pack or load a sequence of natural numbers"},
 
-    {"zig", polyadicts_zig, METH_VARARGS,
+    {"load_many", (PyCFunction)polyadicts_load_many, METH_VARARGS | METH_KEYWORDS,
+        "load_many(buffer, *, lazy=False, verify=False, trust=False)\n\n"
+        "Load the polyads stored back to back in a buffer, and return them with\n"
+        "the number of bytes they span, where a partial polyad would resume"},
+
+    {"iter_load", (PyCFunction)polyadicts_iter_load, METH_VARARGS | METH_KEYWORDS,
+        "iter_load(buffer, *, lazy=False, verify=False, trust=False)\n\n"
+        "Iterate over the polyads stored back to back in a buffer, see load_many"},
+
+    {"unpack", (PyCFunction)PyPolyad_unpack_buffer, METH_VARARGS | METH_KEYWORDS,
+        "unpack(buffer, *, as_bytes=False, encoding=None, errors='strict')\n\n"
+        "A tuple of the items of a serialized polyad, see polyad.unpack()"},
+
+    {"zig", (PyCFunction)polyadicts_zig, METH_VARARGS | METH_KEYWORDS,
         "ZigZag encode a signed int as unsigned"},
 
-    {"zag", polyadicts_zag, METH_VARARGS,
+    {"zag", (PyCFunction)polyadicts_zag, METH_VARARGS | METH_KEYWORDS,
         "ZigZag decode an unsigned int as signed"},
 
     {NULL} // Sentinel
 };
 
+/* polyadicts module teardown, releasing the cached polyad objects */
+static void
+polyadicts_free(void *module)
+{
+    PyPolyad_ClearFreeList();
+}
+
 /* polyadicts module definition */
 static struct PyModuleDef polyadicts_module = {
     PyModuleDef_HEAD_INIT,
@@ -275,7 +525,7 @@ static struct PyModuleDef polyadicts_module = {
     NULL,
     NULL,
     NULL,
-    NULL
+    polyadicts_free
 };
 
 /* polyadicts module initialization function */
@@ -284,8 +534,18 @@ PyMODINIT_FUNC PyInit_polyadicts (void)
     // Initialize the type objects
     if (PyType_Ready(&PyPolyad_Type) < 0)
         return NULL;
+    if (PyType_Ready(&PyPolyadIter_Type) < 0)
+        return NULL;
     if (PyType_Ready(&PyVaryad_Type) < 0)
         return NULL;
+    if (PyType_Ready(&PyPolyfile_Type) < 0)
+        return NULL;
+    if (PyType_Ready(&PyPolylog_Type) < 0)
+        return NULL;
+    if (PyType_Ready(&PyPolyslab_Type) < 0)
+        return NULL;
+    if (PyType_Ready(&PyPolyloader_Type) < 0)
+        return NULL;
 
     // Initialize module
     PyObject *module = PyModule_Create(&polyadicts_module);
@@ -295,6 +555,12 @@ PyMODINIT_FUNC PyInit_polyadicts (void)
         PyModule_AddObject(module, "polyad", (PyObject*)&PyPolyad_Type);
         Py_INCREF(&PyVaryad_Type);
         PyModule_AddObject(module, "varyad", (PyObject*)&PyVaryad_Type);
+        Py_INCREF(&PyPolyfile_Type);
+        PyModule_AddObject(module, "polyfile", (PyObject*)&PyPolyfile_Type);
+        Py_INCREF(&PyPolylog_Type);
+        PyModule_AddObject(module, "polylog", (PyObject*)&PyPolylog_Type);
+        // Report the varint kernels selected for this CPU
+        PyModule_AddStringConstant(module, "vi_tier", vi_tier());
     }
     return module;
 }
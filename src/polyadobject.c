@@ -18,21 +18,84 @@
 */
 
 #include "polyadobject.h"
+#include "polyadicts_inline.h"
+#include "ntuple.h"
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
 
 /**
  * PyPolyad
  */
 
+/*
+ * A free list of polyad objects by storage class: none (the polyad is
+ * stored elsewhere), then 16 to 128 words, for up to rank 120 loaded.
+ * Free-threaded builds go without, the list being unsynchronized.
+ */
+#define _POLYAD_FREE_CLASSES 5
+#define _POLYAD_FREE_MAX 64
+#define _POLYAD_CLASS_WORDS(k) ((k) ? (Py_ssize_t) 8 << (k) : 0)
+#ifdef Py_GIL_DISABLED
+#define _POLYAD_FREELIST 0
+#else
+#define _POLYAD_FREELIST 1
+#endif
+
+static PyPolyad *_polyad_free[_POLYAD_FREE_CLASSES][_POLYAD_FREE_MAX];
+static int _polyad_nfree[_POLYAD_FREE_CLASSES];
+
+/* A new polyad object with at least {@code words} of storage */
+static PyPolyad *
+_polyad_new(size_t words)
+{
+    PyPolyad *self;
+    int k;
+    if (words > PY_SSIZE_T_MAX / sizeof(size_t)) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (k = 0; k < _POLYAD_FREE_CLASSES && _POLYAD_CLASS_WORDS(k) < (Py_ssize_t) words; k++)
+        ;
+    if (k < _POLYAD_FREE_CLASSES) {
+        words = _POLYAD_CLASS_WORDS(k);
+        if (_POLYAD_FREELIST && _polyad_nfree[k]) {
+            self = _polyad_free[k][--_polyad_nfree[k]];
+            memset(&self->polyad, 0, offsetof(PyPolyad, mem) - offsetof(PyPolyad, polyad));
+            return (PyPolyad*) PyObject_InitVar((PyVarObject*) self, &PyPolyad_Type, words);
+        }
+    }
+    return (PyPolyad*) PyPolyad_Type.tp_alloc(&PyPolyad_Type, words);
+}
+
 void
 PyPolyad_dealloc(PyPolyad* self)
 {
+    int k;
     if (self->polyad)
         polyad_free(self->polyad);
-    if (self->src) {
+    if (self->src)
         PyBuffer_Release(self->src);
-        PyMem_Del(self->src);
+    Py_XDECREF(self->owner);
+
+    /* keep an object of a storage class for reuse */
+    for (k = 0; k < _POLYAD_FREE_CLASSES && _POLYAD_CLASS_WORDS(k) != Py_SIZE(self); k++)
+        ;
+    if (_POLYAD_FREELIST && k < _POLYAD_FREE_CLASSES && _polyad_nfree[k] < _POLYAD_FREE_MAX) {
+        _polyad_free[k][_polyad_nfree[k]++] = self;
+        return;
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+void
+PyPolyad_ClearFreeList(void)
+{
+    int k;
+    for (k = 0; k < _POLYAD_FREE_CLASSES; k++) {
+        while (_polyad_nfree[k])
+            PyPolyad_Type.tp_free((PyObject*)_polyad_free[k][--_polyad_nfree[k]]);
     }
-    self->ob_base.ob_type->tp_free((PyObject*)self);
 }
 
 void
@@ -55,7 +118,7 @@ PyPolyad_SetErrFromErrno()
 }
 
 PyObject *
-PyPolyad_FromBuffer(Py_buffer *view, size_t off, size_t len)
+PyPolyad_FromBuffer(Py_buffer *view, size_t off, size_t len, int flags)
 {
     if (len == 0) {
         len = view->len;
@@ -66,50 +129,67 @@ PyPolyad_FromBuffer(Py_buffer *view, size_t off, size_t len)
         return NULL;
     }
 
-    /* allocate new polyad object */
+    /* allocate new polyad object, with storage for the polyad */
     PyPolyad *self;
-    self = (PyPolyad*) PyPolyad_Type.tp_alloc(&PyPolyad_Type, 0);
-    if (!self)
-        return NULL;
-
-    /* allocate Py_buffer to refcount shared memory region */
-    self->src = PyMem_Malloc(sizeof(Py_buffer));
-    if (!self->src) {
-        PyPolyad_Type.tp_free(self);
+    const size_t size = polyad_sizeof(view->buf + off, len - off);
+    if (!size) {
+        PyPolyad_SetErrFromErrno();
         return NULL;
     }
-    *self->src = *view;
-
-    /* load and initialize polyad pointers from data buffer */
-    if (polyad_load(view->buf + off, len, &self->polyad)) {
-        return (PyObject*) self;
+    self = _polyad_new(size / sizeof(size_t));
+    if (!self)
+        return NULL;
 
-    } else {
-        /* failure */
+    /*
+     * load and initialize polyad pointers from data buffer, pinned by the view;
+     * a load only parses the header, about a size_t per item, so the GIL is
+     * released for a large rank rather than for a large buffer
+     */
+    size_t n, rank;
+    if (!ntuple_rank(view->buf + off, len - off, &rank))
+        rank = 0;
+    PyPolyad_BEGIN_ALLOW_THREADS(rank * sizeof(size_t))
+    n = polyad_load_ex(view->buf + off, len - off, flags, self->mem,
+            Py_SIZE(self) * sizeof(size_t), &self->polyad);
+    PyPolyad_END_ALLOW_THREADS
+    if (!n) {
+        /* failure, leaving the view to the caller */
         PyPolyad_SetErrFromErrno();
-        PyMem_Free(self->src);
-        PyPolyad_Type.tp_free(self);
+        Py_DECREF(self);
         return NULL;
     }
+
+    /* refcount the shared memory region */
+    self->buffer = *view;
+    self->src = &self->buffer;
+    return (PyObject*) self;
 }
 
 PyObject *
-PyPolyad_FromSequence(PyObject *src, const char *errmsg)
+PyPolyad_FromOwner(polyad_t polyad, PyObject *owner)
 {
-    if (NULL == (src = PySequence_Fast(src, errmsg)))
+    PyPolyad *self;
+    self = _polyad_new(0);
+    if (!self)
         return NULL;
+    /* the owner keeps both the polyad struct and its data */
+    self->polyad = polyad;
+    Py_INCREF(owner);
+    self->owner = owner;
+    return (PyObject*) self;
+}
 
-    Py_ssize_t rank = PySequence_Fast_GET_SIZE(src);
-
+/*
+ * Acquire the buffers of a sequence of items (bufferables or str),
+ * returning the number acquired: all of them, or fewer with an exception.
+ */
+static Py_ssize_t
+_polyad_items(PyObject *src, Py_ssize_t rank, Py_buffer *view,
+        const void **items, size_t *lens, const char *errmsg)
+{
     Py_ssize_t i;
-    Py_buffer view[rank];
-    const void *items[rank];
-    size_t lens[rank];
     Py_ssize_t utf_len;
 
-    polyad_t polyad = NULL;
-    PyPolyad *self = NULL;
-
     for (i = 0; i < rank; i++) {
         PyObject *const obj = PySequence_Fast_GET_ITEM(src, i);
         if (PyObject_CheckBuffer(obj) &&
@@ -128,33 +208,108 @@ PyPolyad_FromSequence(PyObject *src, const char *errmsg)
             break;
         }
     }
-
-    if (i == rank) {
-        /* initialize the polyad from the item buffers */
-        polyad_init(rank, items, lens, &polyad);
-    } else {
+    if (i < rank) {
         PyErr_SetString(PyExc_TypeError, errmsg);
     }
+    return i;
+}
 
-    /* release all open buffers */
-    rank = i;
-    for (i = 0; i < rank; i++) {
+/* Release the first {@code n} buffers acquired by _polyad_items */
+static void
+_polyad_release(Py_ssize_t n, Py_buffer *view)
+{
+    Py_ssize_t i;
+    for (i = 0; i < n; i++) {
         if (view[i].buf) {
             PyBuffer_Release(&view[i]);
         }
     }
+}
+
+/* Append a copy of an item (bufferable or str) to a polyad builder */
+static int
+_polyad_append(struct polyad_builder *b, PyObject *obj, const char *errmsg)
+{
+    Py_buffer view;
+    const char *utf;
+    Py_ssize_t utf_len;
+    size_t n;
+
+    /* the copy of a large item lets other threads run, the item being pinned */
+    if (PyObject_CheckBuffer(obj) &&
+            0 == PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE)) {
+        PyPolyad_BEGIN_ALLOW_THREADS(view.len)
+        n = polyad_builder_append(b, view.buf, view.len);
+        PyPolyad_END_ALLOW_THREADS
+        PyBuffer_Release(&view);
+    } else if (PyUnicode_Check(obj) && 0 == PyUnicode_READY(obj) &&
+            (utf = PyUnicode_AsUTF8AndSize(obj, &utf_len))) {
+        PyPolyad_BEGIN_ALLOW_THREADS(utf_len)
+        n = polyad_builder_append(b, utf, utf_len);
+        PyPolyad_END_ALLOW_THREADS
+    } else {
+        PyErr_SetString(PyExc_TypeError, errmsg);
+        return 0;
+    }
+    if (!n) {
+        PyPolyad_SetErrFromErrno();
+    }
+    return n != 0;
+}
+
+/* The greatest length hint reserved for by PyPolyad_FromSequence */
+#define _POLYAD_HINT_MAX 1024
+
+PyObject *
+PyPolyad_FromSequence(PyObject *src, int format, const char *errmsg)
+{
+    struct polyad_builder b;
+    PyObject *iter, *obj;
+    Py_ssize_t hint;
+
+    polyad_t polyad = NULL;
+    PyPolyad *self = NULL;
+
+    if (NULL == (iter = PyObject_GetIter(src))) {
+        PyErr_SetString(PyExc_TypeError, errmsg);
+        return NULL;
+    }
+    /* a hint may be wrong, so reserve for no more than a typical rank */
+    hint = PyObject_LengthHint(src, 0);
+    if (hint < 0) {
+        Py_DECREF(iter);
+        return NULL;
+    }
+    hint = hint < _POLYAD_HINT_MAX ? hint : _POLYAD_HINT_MAX;
+    if (!polyad_builder_init(&b, hint, format)) {
+        Py_DECREF(iter);
+        PyPolyad_SetErrFromErrno();
+        return NULL;
+    }
+
+    /* copy each item into the polyad, holding one item buffer at a time */
+    while ((obj = PyIter_Next(iter))) {
+        const int ok = _polyad_append(&b, obj, errmsg);
+        Py_DECREF(obj);
+        if (!ok)
+            break;
+    }
+    Py_DECREF(iter);
+
+    if (PyErr_Occurred()) {
+        polyad_builder_free(&b);
+    } else if (!polyad_builder_finish(&b, &polyad)) {
+        PyPolyad_SetErrFromErrno();
+    }
 
     /* allocate new PyPolyad object */
     if (polyad) {
-        self = (PyPolyad*) PyPolyad_Type.tp_alloc(&PyPolyad_Type, 0);
+        self = _polyad_new(0);
         if (self) {
             self->polyad = polyad;
-            self->src = NULL;
         } else {
             polyad_free(polyad);
         }
-    } else if (!PyErr_Occurred()) {
-        PyPolyad_SetErrFromErrno();
     }
     return (PyObject*) self;
 }
@@ -162,29 +317,462 @@ PyPolyad_FromSequence(PyObject *src, const char *errmsg)
 PyObject *
 PyPolyad_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
+    static char *kwlist[] = {"", "group", "indexed", "lazy", "verify", "trust", NULL};
     PyObject *src;
-    if (!PyArg_ParseTuple(args, "O", &src))
+    int group = 0, indexed = 0, lazy = 0, verify = 0, trust = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$ppppp:polyad", kwlist,
+            &src, &group, &indexed, &lazy, &verify, &trust))
         return NULL;
 
     Py_buffer view;
-    if (PyObject_CheckBuffer(src) &&
-            0 == PyObject_GetBuffer(src, &view, PyBUF_SIMPLE)) {
-        PyObject *pack = PyPolyad_FromBuffer(&view, 0, 0);
-        if (!pack)
-            PyBuffer_Release(&view);
-        return pack;
+    if (PyObject_CheckBuffer(src)) {
+        if (group || indexed) {
+            PyErr_SetString(PyExc_TypeError, "group and indexed only apply when packing");
+            return NULL;
+        }
+        if (0 == PyObject_GetBuffer(src, &view, PyBUF_SIMPLE)) {
+            PyObject *pack = PyPolyad_FromBuffer(&view, 0, 0, (lazy ? POLYAD_LAZY : 0) |
+                    (verify ? POLYAD_VERIFY : 0) | (trust ? POLYAD_TRUST : 0));
+            if (!pack)
+                PyBuffer_Release(&view);
+            return pack;
+        }
     }
 
-    return PyPolyad_FromSequence(src,
+    if (lazy || verify || trust) {
+        PyErr_SetString(PyExc_TypeError, "lazy, verify and trust only apply when loading");
+        return NULL;
+    } else if (group && indexed) {
+        PyErr_SetString(PyExc_ValueError, "group and indexed are exclusive");
+        return NULL;
+    }
+    return PyPolyad_FromSequence(src, group ? POLYAD_FORMAT_GROUP :
+            indexed ? POLYAD_FORMAT_INDEXED : POLYAD_FORMAT_VARINT,
             "expected a sequence (encode) or bufferable (decode)");
 }
 
+/*
+ * The item buffers and packed header of a polyad to be written in place,
+ * allocated at once for the I/O vector of its header and items.
+ */
+struct _polyad_iov {
+    Py_ssize_t rank;
+    Py_ssize_t acquired;
+    Py_buffer *view;
+    const void **items;
+    size_t *lens;
+    struct iovec *iov;
+    size_t size;
+};
+
+static int
+_polyad_iov_init(struct _polyad_iov *v, PyObject *src, int format, const char *errmsg)
+{
+    size_t hdrlen;
+    char *mem;
+
+    v->rank = PySequence_Fast_GET_SIZE(src);
+    v->acquired = 0;
+    v->iov = NULL;
+    hdrlen = POLYAD_HEADER_MAX_SIZE(v->rank);
+    mem = PyMem_Malloc(v->rank * (sizeof(Py_buffer) + sizeof(void *) + sizeof(size_t)) +
+            (v->rank + 1) * sizeof(struct iovec) + hdrlen);
+    if (!mem) {
+        PyErr_NoMemory();
+        return 0;
+    }
+    v->iov = (struct iovec *) mem;
+    v->view = (Py_buffer *) (v->iov + v->rank + 1);
+    v->items = (const void **) (v->view + v->rank);
+    v->lens = (size_t *) (v->items + v->rank);
+
+    v->acquired = _polyad_items(src, v->rank, v->view, v->items, v->lens, errmsg);
+    if (v->acquired == v->rank) {
+        v->size = polyad_iov(v->rank, v->items, v->lens, format,
+                v->lens + v->rank, hdrlen, v->iov);
+        if (v->size) {
+            return 1;
+        }
+        PyPolyad_SetErrFromErrno();
+    }
+    return 0;
+}
+
+static void
+_polyad_iov_release(struct _polyad_iov *v)
+{
+    _polyad_release(v->acquired, v->view);
+    PyMem_Free(v->iov);
+}
+
+/* Parse the items and header format options of writev() and iov() */
+static PyObject *
+_polyad_iov_args(PyObject *args, PyObject *kwds, const char *format, char **kwlist,
+        int *fd, int *packing)
+{
+    PyObject *src, *fdobj;
+    int group = 0, indexed = 0;
+    if (fd) {
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, format, kwlist,
+                &fdobj, &src, &group, &indexed))
+            return NULL;
+        *fd = PyObject_AsFileDescriptor(fdobj);
+        if (*fd < 0)
+            return NULL;
+    } else if (!PyArg_ParseTupleAndKeywords(args, kwds, format, kwlist,
+                &src, &group, &indexed)) {
+        return NULL;
+    }
+    if (group && indexed) {
+        PyErr_SetString(PyExc_ValueError, "group and indexed are exclusive");
+        return NULL;
+    }
+    *packing = group ? POLYAD_FORMAT_GROUP :
+            indexed ? POLYAD_FORMAT_INDEXED : POLYAD_FORMAT_VARINT;
+    return PySequence_Fast(src, "expected a sequence of items");
+}
+
+PyObject *
+PyPolyad_writev(PyObject *cls, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"fd", "items", "group", "indexed", NULL};
+    struct _polyad_iov v;
+    struct iovec *iov;
+    PyObject *src, *ret;
+    ssize_t n;
+    int fd, format, count;
+    size_t left;
+
+    src = _polyad_iov_args(args, kwds, "OO|$pp:writev", kwlist, &fd, &format);
+    if (!src)
+        return NULL;
+
+    ret = NULL;
+    if (_polyad_iov_init(&v, src, format, "expected a sequence of bufferables or str")) {
+        iov = v.iov;
+        count = v.rank + 1;
+        left = v.size;
+        while (left) {
+            Py_BEGIN_ALLOW_THREADS
+            n = writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+            Py_END_ALLOW_THREADS
+            if (n < 0) {
+                if (errno == EINTR && !PyErr_CheckSignals())
+                    continue;
+                if (!PyErr_Occurred())
+                    PyErr_SetFromErrno(PyExc_OSError);
+                break;
+            }
+            /* skip the vectors written, and advance into a partial one */
+            left -= n;
+            for (; count && (size_t) n >= iov->iov_len; iov++, count--) {
+                n -= iov->iov_len;
+            }
+            if (n) {
+                iov->iov_base = (char *) iov->iov_base + n;
+                iov->iov_len -= n;
+            }
+        }
+        if (!left) {
+            ret = PyLong_FromSize_t(v.size);
+        }
+    }
+    _polyad_iov_release(&v);
+    Py_DECREF(src);
+    return ret;
+}
+
+PyObject *
+PyPolyad_iov(PyObject *cls, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"items", "group", "indexed", NULL};
+    struct _polyad_iov v;
+    PyObject *src, *ret, *obj;
+    Py_ssize_t i;
+    int format;
+
+    src = _polyad_iov_args(args, kwds, "O|$pp:iov", kwlist, NULL, &format);
+    if (!src)
+        return NULL;
+
+    ret = NULL;
+    if (_polyad_iov_init(&v, src, format, "expected a sequence of bufferables or str")) {
+        ret = PyList_New(v.rank + 1);
+        if (ret) {
+            obj = PyBytes_FromStringAndSize(v.iov[0].iov_base, v.iov[0].iov_len);
+            for (i = 0; obj; ) {
+                PyList_SET_ITEM(ret, i, obj);
+                if (++i > v.rank)
+                    break;
+                if (v.view[i - 1].buf) {
+                    obj = PyMemoryView_FromObject(PySequence_Fast_GET_ITEM(src, i - 1));
+                } else {
+                    /* the UTF-8 encoding of a str */
+                    obj = PyBytes_FromStringAndSize(v.items[i - 1], v.lens[i - 1]);
+                }
+            }
+            if (!obj) {
+                Py_CLEAR(ret);
+            }
+        }
+    }
+    _polyad_iov_release(&v);
+    Py_DECREF(src);
+    return ret;
+}
+
+/*
+ * A memoryview of part of a polyad, which holds a reference to the polyad
+ * (which that of PyMemoryView_FromBuffer does not).
+ */
+static PyObject *
+_polyad_view(PyPolyad *self, const void *buf, size_t len)
+{
+    PyObject *view;
+    self->region = buf;
+    self->region_len = len;
+    view = PyMemoryView_FromObject((PyObject*) self);
+    self->region = NULL;
+    return view;
+}
+
+PyObject *
+PyPolyad_get(PyObject *obj_self, PyObject *path)
+{
+    PyPolyad *self = (PyPolyad*) obj_self;
+    PyObject *seq;
+    Py_ssize_t depth, j, i;
+    const void *item;
+    size_t rank, len;
+
+    if (PyIndex_Check(path)) {
+        seq = PyTuple_Pack(1, path);
+    } else {
+        seq = PySequence_Fast(path, "expected an index or a sequence of indices");
+    }
+    if (!seq)
+        return NULL;
+    depth = PySequence_Fast_GET_SIZE(seq);
+
+    /* walk the nested headers in place, from the item at each level */
+    item = polyad_data_inline(self->polyad);
+    len = 0;
+    for (j = 0; j < depth; j++) {
+        i = PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(seq, j), PyExc_IndexError);
+        if (i == -1 && PyErr_Occurred())
+            break;
+        if (j == 0) {
+            rank = polyad_rank_inline(self->polyad);
+        } else if (!ntuple_rank(item, len, &rank)) {
+            item = NULL;
+            break;
+        }
+        if (i < 0)
+            i += rank;
+        if (i < 0 || (size_t) i >= rank) {
+            PyErr_SetString(PyExc_IndexError, "pack index out of range");
+            break;
+        }
+        if (j == 0) {
+            len = polyad_item_inline(self->polyad, i, &item);
+        } else {
+            len = polyad_locate(item, len, i, &item);
+        }
+        if (!item)
+            break;
+    }
+    Py_DECREF(seq);
+
+    if (j < depth) {
+        if (!PyErr_Occurred())
+            PyPolyad_SetErrFromErrno();
+        return NULL;
+    } else if (depth == 0) {
+        Py_INCREF(obj_self);
+        return obj_self;
+    }
+    return _polyad_view(self, item, len);
+}
+
+/* The values unpacked from the items of a polyad */
+enum {
+    _POLYAD_UNPACK_VIEW,
+    _POLYAD_UNPACK_BYTES,
+    _POLYAD_UNPACK_STR,
+};
+
+/*
+ * The value of an item, at {@code item} in the polyad data at {@code base}:
+ * a slice of the memoryview {@code view} of the data, bytes, or str.
+ */
+static PyObject *
+_polyad_unpack_item(PyObject *view, const char *base, const char *item, size_t len,
+        int mode, const char *encoding, const char *errors)
+{
+    switch (mode) {
+      case _POLYAD_UNPACK_BYTES:
+        return PyBytes_FromStringAndSize(item, len);
+      case _POLYAD_UNPACK_STR:
+        return PyUnicode_Decode(item, len, encoding, errors);
+      default:
+        /* the slices of one view share its export */
+        return PySequence_GetSlice(view, item - base, item - base + len);
+    }
+}
+
+/* Unpack the items of a polyad into a tuple */
+static PyObject *
+_polyad_unpack(polyad_t polyad, PyObject *view, int mode, const char *encoding,
+        const char *errors)
+{
+    const size_t rank = polyad_rank_inline(polyad);
+    const char *const base = polyad_data_inline(polyad);
+    const void *item;
+    PyObject *ret, *obj;
+    size_t i, len;
+
+    ret = PyTuple_New(rank);
+    if (!ret)
+        return NULL;
+    for (i = 0; i < rank; i++) {
+        len = polyad_item_inline(polyad, i, &item);
+        if (!item) {
+            PyPolyad_SetErrFromErrno();
+            break;
+        }
+        obj = _polyad_unpack_item(view, base, item, len, mode, encoding, errors);
+        if (!obj)
+            break;
+        PyTuple_SET_ITEM(ret, i, obj);
+    }
+    if (i < rank)
+        Py_CLEAR(ret);
+    return ret;
+}
+
+/* The unpack mode of the options of unpack(), or -1 with an exception */
+static int
+_polyad_unpack_mode(int as_bytes, const char *encoding)
+{
+    if (as_bytes && encoding) {
+        PyErr_SetString(PyExc_ValueError, "as_bytes and encoding are exclusive");
+        return -1;
+    }
+    return encoding ? _POLYAD_UNPACK_STR : as_bytes ? _POLYAD_UNPACK_BYTES :
+            _POLYAD_UNPACK_VIEW;
+}
+
+PyObject *
+PyPolyad_unpack(PyObject *obj_self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"as_bytes", "encoding", "errors", NULL};
+    PyPolyad *self = (PyPolyad*) obj_self;
+    const char *encoding = NULL, *errors = NULL;
+    PyObject *view, *ret;
+    int as_bytes = 0, mode;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$pzz:unpack", kwlist,
+            &as_bytes, &encoding, &errors))
+        return NULL;
+    mode = _polyad_unpack_mode(as_bytes, encoding);
+    if (mode < 0)
+        return NULL;
+
+    view = NULL;
+    if (mode == _POLYAD_UNPACK_VIEW) {
+        view = PyMemoryView_FromObject(obj_self);
+        if (!view)
+            return NULL;
+    }
+    ret = _polyad_unpack(self->polyad, view, mode, encoding, errors);
+    Py_XDECREF(view);
+    return ret;
+}
+
+PyObject *
+PyPolyad_unpack_buffer(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "as_bytes", "encoding", "errors", NULL};
+    const char *encoding = NULL, *errors = NULL;
+    PyObject *src, *view, *bytes, *ret;
+    const Py_buffer *buf;
+    polyad_t polyad;
+    int as_bytes = 0, mode;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$pzz:unpack", kwlist,
+            &src, &as_bytes, &encoding, &errors))
+        return NULL;
+    mode = _polyad_unpack_mode(as_bytes, encoding);
+    if (mode < 0)
+        return NULL;
+
+    /* the items of a serialized polyad, without a polyad object, verified
+     * since they are all read from a buffer of unknown origin */
+    view = PyMemoryView_FromObject(src);
+    if (!view)
+        return NULL;
+    buf = PyMemoryView_GET_BUFFER(view);
+    if (!PyBuffer_IsContiguous(buf, 'C')) {
+        PyErr_SetString(PyExc_TypeError, "expected a contiguous buffer");
+        Py_DECREF(view);
+        return NULL;
+    }
+    if (buf->ndim != 1 || !buf->format || strcmp(buf->format, "B")) {
+        /* the items are sliced at byte offsets, whatever the source items */
+        bytes = PyObject_CallMethod(view, "cast", "s", "B");
+        Py_DECREF(view);
+        if (!bytes)
+            return NULL;
+        view = bytes;
+        buf = PyMemoryView_GET_BUFFER(view);
+    }
+    ret = NULL;
+    if (!polyad_load_ex(buf->buf, buf->len, POLYAD_VERIFY, NULL, 0, &polyad)) {
+        PyPolyad_SetErrFromErrno();
+    } else {
+        ret = _polyad_unpack(polyad, view, mode, encoding, errors);
+        polyad_free(polyad);
+    }
+    Py_DECREF(view);
+    return ret;
+}
+
+PyMethodDef PyPolyad_methods[] = {
+    {"writev", (PyCFunction)PyPolyad_writev, METH_VARARGS | METH_KEYWORDS | METH_STATIC,
+     "writev(fd, items, *, group=False, indexed=False)\n\n"
+     "Write a polyad of items to a file descriptor, without copying them,\n"
+     "returning the number of bytes written."},
+    {"iov", (PyCFunction)PyPolyad_iov, METH_VARARGS | METH_KEYWORDS | METH_STATIC,
+     "iov(items, *, group=False, indexed=False)\n\n"
+     "The packed header of a polyad of items followed by a memoryview of\n"
+     "each item, as taken by os.writev() or socket.sendmsg()."},
+    {"unpack", (PyCFunction)PyPolyad_unpack, METH_VARARGS | METH_KEYWORDS,
+     "unpack(*, as_bytes=False, encoding=None, errors='strict')\n\n"
+     "A tuple of the items: memoryviews sharing one export of the polyad,\n"
+     "bytes, or str decoded with an encoding."},
+    {"get", (PyCFunction)PyPolyad_get, METH_O,
+     "get(path)\n\n"
+     "A memoryview of the item at a path of indices through nested polyads:\n"
+     "p.get((1, 3, 0)) views the bytes of p[1][3][0], without loading the\n"
+     "polyads in between."},
+    {NULL, NULL, 0, NULL}
+};
+
 /* PyPolyad buffer API */
 int
 PyPolyad_getbuffer(PyPolyad *self, Py_buffer *view, int flags)
 {
-    return PyBuffer_FillInfo(view, (PyObject*)self, (void *) polyad_data(self->polyad),
-            polyad_size(self->polyad), true, PyBUF_SIMPLE);
+    if (self->region) {
+        return PyBuffer_FillInfo(view, (PyObject*)self, (void *) self->region,
+                self->region_len, true, PyBUF_SIMPLE);
+    }
+    const size_t size = polyad_size_inline(self->polyad);
+    if (!size) {
+        /* a lazy polyad's header is invalid */
+        PyPolyad_SetErrFromErrno();
+        view->obj = NULL;
+        return -1;
+    }
+    return PyBuffer_FillInfo(view, (PyObject*)self, (void *) polyad_data_inline(self->polyad),
+            size, true, PyBUF_SIMPLE);
 }
 
 PyBufferProcs PyPolyad_as_buffer = {
@@ -196,24 +784,26 @@ PyBufferProcs PyPolyad_as_buffer = {
 Py_ssize_t
 PyPolyad_length(PyObject *self)
 {
-    return polyad_rank(((PyPolyad*)self)->polyad);
+    return polyad_rank_inline(((PyPolyad*)self)->polyad);
 }
 
 PyObject*
 PyPolyad_item(PyObject *obj_self, Py_ssize_t i)
 {
     PyPolyad *self = (PyPolyad*) obj_self;
-    if (i >= polyad_rank(self->polyad)) {
+    if (i >= polyad_rank_inline(self->polyad)) {
         PyErr_SetString(PyExc_IndexError, "pack index out of range");
         return NULL;
     }
 
-    Py_buffer view;
-    if (0 == PyObject_GetBuffer(obj_self, &view, PyBUF_SIMPLE)) {
-        view.len = polyad_item(self->polyad, i, (const void **) &view.buf);
-        return PyMemoryView_FromBuffer(&view);
+    const void *item;
+    const size_t len = polyad_item_inline(self->polyad, i, &item);
+    if (!item) {
+        PyPolyad_SetErrFromErrno();
+        return NULL;
     }
-    return NULL;
+    /* refer to the item alone, without resolving a lazy polyad's size */
+    return _polyad_view(self, item, len);
 }
 
 PySequenceMethods PyPolyad_as_sequence = {
@@ -227,12 +817,91 @@ PySequenceMethods PyPolyad_as_sequence = {
     NULL,                       /*sq_inplace_repeat*/
 };
 
+/* PyPolyad iterator API */
+PyObject *
+PyPolyad_iter(PyObject *self)
+{
+    PyPolyadIter *it;
+    it = PyObject_New(PyPolyadIter, &PyPolyadIter_Type);
+    if (!it)
+        return NULL;
+    Py_INCREF(self);
+    it->pack = (PyPolyad*) self;
+    it->view = NULL;
+    it->next = 0;
+    return (PyObject*) it;
+}
+
+static void
+PyPolyadIter_dealloc(PyPolyadIter *it)
+{
+    Py_XDECREF(it->view);
+    Py_DECREF(it->pack);
+    PyObject_Del(it);
+}
+
+static PyObject *
+PyPolyadIter_iternext(PyPolyadIter *it)
+{
+    const polyad_t polyad = it->pack->polyad;
+    const void *item;
+    size_t len;
+    if (it->next >= polyad_rank_inline(polyad))
+        return NULL;
+
+    /* one export of the polyad for all its items */
+    if (!it->view) {
+        it->view = PyMemoryView_FromObject((PyObject*) it->pack);
+        if (!it->view)
+            return NULL;
+    }
+    len = polyad_item_inline(polyad, it->next, &item);
+    if (!item) {
+        PyPolyad_SetErrFromErrno();
+        return NULL;
+    }
+    it->next++;
+    return _polyad_unpack_item(it->view, polyad_data_inline(polyad), item, len,
+            _POLYAD_UNPACK_VIEW, NULL, NULL);
+}
+
+/* PyPolyadIter type definition */
+PyTypeObject PyPolyadIter_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "polyadicts.polyad_iterator", /*tp_name*/
+    sizeof(PyPolyadIter),       /*tp_basicsize*/
+    0,                          /*tp_itemsize*/
+    (destructor)PyPolyadIter_dealloc, /*tp_dealloc*/
+    0,                          /*tp_print*/
+    0,                          /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    0,                          /*tp_repr*/
+    0,                          /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    0,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    0,                          /* tp_doc */
+    0,                          /* tp_traverse */
+    0,                          /* tp_clear */
+    0,                          /* tp_richcompare */
+    0,                          /* tp_weaklistoffset */
+    PyObject_SelfIter,          /* tp_iter */
+    (iternextfunc)PyPolyadIter_iternext, /* tp_iternext */
+};
+
 /* PyPolyad type definition */
 PyTypeObject PyPolyad_Type = {
     PyVarObject_HEAD_INIT(NULL, 0)
     "polyadicts.polyad",        /*tp_name*/
-    sizeof(PyPolyad),           /*tp_basicsize*/
-    0,                          /*tp_itemsize*/
+    offsetof(PyPolyad, mem),    /*tp_basicsize*/
+    sizeof(size_t),             /*tp_itemsize*/
     (destructor)PyPolyad_dealloc, /*tp_dealloc*/
     0,                          /*tp_print*/
     0,                          /*tp_getattr*/
@@ -249,14 +918,15 @@ PyTypeObject PyPolyad_Type = {
     0,                          /*tp_setattro*/
     &PyPolyad_as_buffer,        /*tp_as_buffer*/
     Py_TPFLAGS_DEFAULT,         /*tp_flags*/
-    "polyad(bufferable | sequence)", /* tp_doc */
+    "polyad(bufferable | sequence, *, group=False, indexed=False, lazy=False,\n"
+    "verify=False, trust=False)", /* tp_doc */
     0,                          /* tp_traverse */
     0,                          /* tp_clear */
     0,                          /* tp_richcompare */
     0,                          /* tp_weaklistoffset */
-    0,                          /* tp_iter */
+    PyPolyad_iter,              /* tp_iter */
     0,                          /* tp_iternext */
-    0,                          /* tp_methods */
+    PyPolyad_methods,           /* tp_methods */
     0,                          /* tp_members */
     0,                          /* tp_getset */
     0,                          /* tp_base */
@@ -26,21 +26,67 @@
 
 typedef struct PyPolyad_st
 {
-    PyObject_HEAD
-    /* underlying C polyad object */
+    PyObject_VAR_HEAD
+    /* underlying C polyad object, in mem when loaded from a buffer */
     polyad_t polyad;
-    /* references to parent buffer object, if used */
+    /* references to parent buffer object, if used: the buffer below */
     Py_buffer *src;
+    Py_buffer buffer;
+    /* the object owning the storage of the polyad and its data, if any */
+    PyObject *owner;
+    /* the item exported instead of the whole polyad, while one is viewed */
+    const void *region;
+    size_t region_len;
+    /* the storage of a polyad loaded from a buffer, of ob_size words */
+    size_t mem[1];
 } PyPolyad;
 
+/*
+ * The size in bytes from which copying or parsing a pinned buffer releases
+ * the GIL, below which releasing and taking it again costs more than it
+ * lets other threads run.
+ */
+#define PYPOLYAD_NOGIL_SIZE (64 * 1024)
+
+/* Py_BEGIN/END_ALLOW_THREADS, when {@code size} reaches PYPOLYAD_NOGIL_SIZE */
+#define PyPolyad_BEGIN_ALLOW_THREADS(size) { \
+        PyThreadState *_save = (size) >= PYPOLYAD_NOGIL_SIZE ? PyEval_SaveThread() : NULL;
+#define PyPolyad_END_ALLOW_THREADS \
+        if (_save) PyEval_RestoreThread(_save); }
+
+/* An iterator over the items of a polyad */
+typedef struct PyPolyadIter_st
+{
+    PyObject_HEAD
+    /* the polyad iterated */
+    PyPolyad *pack;
+    /* a memoryview of the polyad, sliced for each item */
+    PyObject *view;
+    /* the index of the next item */
+    size_t next;
+} PyPolyadIter;
+
 PyAPI_FUNC(void) PyPolyad_SetErrFromErrno(void);
 
 PyAPI_FUNC(void) PyPolyad_dealloc(PyPolyad* self);
+PyAPI_FUNC(void) PyPolyad_ClearFreeList(void);
 PyAPI_FUNC(PyObject *) PyPolyad_tp_new(PyTypeObject *type, PyObject *args,
         PyObject *kwds);
 PyAPI_FUNC(PyObject *) PyPolyad_FromBuffer(Py_buffer *view, size_t off,
-        size_t len);
-PyAPI_FUNC(PyObject *) PyPolyad_FromSequence(PyObject *seq, const char *errmsg);
+        size_t len, int flags);
+PyAPI_FUNC(PyObject *) PyPolyad_FromSequence(PyObject *seq, int format,
+        const char *errmsg);
+PyAPI_FUNC(PyObject *) PyPolyad_FromOwner(polyad_t polyad, PyObject *owner);
+
+/* PyPolyad static methods */
+PyAPI_FUNC(PyObject *) PyPolyad_writev(PyObject *cls, PyObject *args, PyObject *kwds);
+PyAPI_FUNC(PyObject *) PyPolyad_iov(PyObject *cls, PyObject *args, PyObject *kwds);
+
+/* PyPolyad methods */
+PyAPI_FUNC(PyObject *) PyPolyad_get(PyObject *self, PyObject *path);
+PyAPI_FUNC(PyObject *) PyPolyad_unpack(PyObject *self, PyObject *args, PyObject *kwds);
+PyAPI_FUNC(PyObject *) PyPolyad_unpack_buffer(PyObject *module, PyObject *args,
+        PyObject *kwds);
 
 /* PyPolyad buffer API */
 PyAPI_FUNC(int) PyPolyad_getbuffer(PyPolyad *self, Py_buffer *view, int flags);
@@ -49,7 +95,11 @@ PyAPI_FUNC(int) PyPolyad_getbuffer(PyPolyad *self, Py_buffer *view, int flags);
 PyAPI_FUNC(Py_ssize_t) PyPolyad_length(PyObject *self);
 PyAPI_FUNC(PyObject *) PyPolyad_item(PyObject *self, Py_ssize_t i);
 
-/* PyPolyad type definition */
+/* PyPolyad iterator API */
+PyAPI_FUNC(PyObject *) PyPolyad_iter(PyObject *self);
+
+/* PyPolyad and PyPolyadIter type definitions */
 PyAPI_DATA(PyTypeObject) PyPolyad_Type;
+PyAPI_DATA(PyTypeObject) PyPolyadIter_Type;
 
 #endif
@@ -0,0 +1,442 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "polyfile.h"
+
+int
+polyfile_map(int fd, int advice, struct polyfile *f)
+{
+    struct stat st;
+    void *data;
+    f->data = NULL;
+    f->size = 0;
+    if (fstat(fd, &st)) {
+        return 0;
+    }
+    if ((uintmax_t) st.st_size > SIZE_MAX) {
+        errno = EFBIG;
+        return 0;
+    }
+    if (!st.st_size) {
+        return 1;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    /* the advice is only a hint, whether or not it is taken */
+    if (advice & POLYFILE_SEQUENTIAL) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+    }
+    if (advice & POLYFILE_WILLNEED) {
+        madvise(data, st.st_size, MADV_WILLNEED);
+    }
+    f->data = data;
+    f->size = st.st_size;
+    return 1;
+}
+
+void
+polyfile_unmap(struct polyfile *f)
+{
+    if (f->data) {
+        munmap((void *) f->data, f->size);
+    }
+    f->data = NULL;
+    f->size = 0;
+}
+
+size_t
+polyfile_next(const struct polyfile *f, size_t *off, polyad_t *p)
+{
+    size_t n;
+    if (*off >= f->size) {
+        return 0;
+    }
+    n = polyad_reload((const char *) f->data + *off, f->size - *off, p);
+    if (n) {
+        /* the whole polyad, of which a lazy load reads only the header */
+        n = polyad_size(*p);
+        if (!n || n > f->size - *off) {
+            if (n) {
+                errno = EINVAL;
+            }
+            return 0;
+        }
+        *off += n;
+    }
+    return n;
+}
+
+int
+polyindex_init(struct polyindex *ix, size_t stride)
+{
+    memset(ix, 0, sizeof(*ix));
+    if (!stride) {
+        errno = EINVAL;
+        return 0;
+    }
+    ix->stride = stride;
+    return 1;
+}
+
+int
+polyindex_add(struct polyindex *ix, size_t off, size_t size)
+{
+    size_t *offsets, cap;
+    if (off < ix->size) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (ix->records % ix->stride == 0) {
+        cap = ix->records / ix->stride;
+        if (cap == ix->capacity) {
+            cap = cap ? 2 * cap : 64;
+            offsets = realloc(ix->offsets, cap * sizeof(size_t));
+            if (!offsets) {
+                return 0;
+            }
+            ix->offsets = offsets;
+            ix->capacity = cap;
+        }
+        ix->offsets[ix->records / ix->stride] = off;
+    }
+    ix->records++;
+    ix->size = off + size;
+    return 1;
+}
+
+int
+polyindex_build(struct polyindex *ix, const struct polyfile *f)
+{
+    const char *const data = f->data;
+    size_t off, n;
+    for (off = ix->size; off < f->size; off += n) {
+        n = polyad_span(data + off, f->size - off);
+        if (!n || !polyindex_add(ix, off, n)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+size_t
+polyindex_pack(const struct polyindex *ix, void *dst, size_t len)
+{
+    const size_t head[3] = { ix->stride, ix->records, ix->size };
+    size_t n, m;
+    n = ntuple_pack(3, head, dst, len);
+    if (!n) {
+        return 0;
+    }
+    m = ntuple_encode((ix->records + ix->stride - 1) / ix->stride, ix->offsets,
+            NTUPLE_DELTA, (char *) dst + n, len - n);
+    return m ? n + m : 0;
+}
+
+size_t
+polyindex_load(const void *src, size_t len, struct polyindex *ix)
+{
+    size_t head[3], rank, count, n, m, i;
+    memset(ix, 0, sizeof(*ix));
+    n = ntuple_rank(src, len, &rank);
+    if (n && rank != 3) {
+        errno = EINVAL;
+        return 0;
+    }
+    n = n ? ntuple_load(src, len, 3, head) : 0;
+    if (!n) {
+        return 0;
+    }
+    count = head[0] ? head[1] / head[0] + (head[1] % head[0] != 0) : 0;
+    m = ntuple_rank((const char *) src + n, len - n, &rank);
+    if (!head[0] || (m && rank != count)) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (!m) {
+        return 0;
+    }
+    /*
+     * an untrusted count, of distinct offsets within the file, which no
+     * packing stores in fewer bytes than half a bit-packed block each
+     */
+    if (count > head[2] || count > SIZE_MAX / sizeof(size_t) ||
+            count / (BITPACK_BLOCK / 2) > len - n) {
+        errno = EINVAL;
+        return 0;
+    }
+    ix->offsets = malloc((count ? count : 1) * sizeof(size_t));
+    if (!ix->offsets) {
+        return 0;
+    }
+    ix->capacity = count;
+    ix->stride = head[0];
+    ix->records = head[1];
+    ix->size = head[2];
+    m = ntuple_decode((const char *) src + n, len - n, NTUPLE_DELTA, count, ix->offsets);
+    /* the deltas wrap around, so each offset must follow the last within the file */
+    for (i = 0; m && i < count; i++) {
+        if (ix->offsets[i] >= ix->size || (i && ix->offsets[i] <= ix->offsets[i - 1])) {
+            errno = EINVAL;
+            m = 0;
+        }
+    }
+    if (!m) {
+        polyindex_free(ix);
+        return 0;
+    }
+    return n + m;
+}
+
+void
+polyindex_free(struct polyindex *ix)
+{
+    free(ix->offsets);
+    ix->offsets = NULL;
+    ix->capacity = ix->records = 0;
+}
+
+/*
+ * Skip the records of a file from record {@code i} at offset {@code o},
+ * up to record {@code record} or the first starting at or after {@code pos}.
+ */
+static int
+polyindex_skip(const struct polyfile *f, size_t i, size_t o, size_t record, size_t pos,
+        size_t *at, size_t *off)
+{
+    const char *const data = f->data;
+    size_t n;
+    if (o > f->size) {
+        /* indexed beyond the end of the file */
+        errno = EINVAL;
+        return 0;
+    }
+    for (; i < record && o < pos && o < f->size; i++, o += n) {
+        n = polyad_span(data + o, f->size - o);
+        if (!n) {
+            return 0;
+        }
+    }
+    *at = i;
+    *off = o;
+    return 1;
+}
+
+int
+polyindex_seek(const struct polyindex *ix, const struct polyfile *f, size_t record,
+        size_t *off)
+{
+    size_t n, o, at;
+    n = o = 0;
+    if (ix && ix->records) {
+        /* the nearest indexed record at or before it */
+        n = record < ix->records ? record / ix->stride : (ix->records - 1) / ix->stride;
+        o = ix->offsets[n];
+        n *= ix->stride;
+    }
+    if (!polyindex_skip(f, n, o, record, (size_t) -1, &at, off)) {
+        return 0;
+    }
+    if (at < record) {
+        /* the file holds fewer records */
+        errno = EINVAL;
+        return 0;
+    }
+    return 1;
+}
+
+int
+polyindex_find(const struct polyindex *ix, const struct polyfile *f, size_t pos,
+        size_t *record, size_t *off)
+{
+    size_t lo, hi, mid, o;
+    lo = o = 0;
+    if (ix && ix->records) {
+        /* the last indexed record starting at or before pos */
+        hi = (ix->records - 1) / ix->stride + 1;
+        while (hi - lo > 1) {
+            mid = lo + (hi - lo) / 2;
+            if (ix->offsets[mid] <= pos) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        o = ix->offsets[lo];
+        lo *= ix->stride;
+    }
+    return polyindex_skip(f, lo, o, (size_t) -1, pos, record, off);
+}
+
+/*
+ * A range of a file scanned by {@code polyfile_scan}
+ */
+struct polyfile_range {
+    struct polyfile_scan *scan;
+    pthread_t thread;
+    size_t range;
+    size_t record;
+    size_t start;
+    size_t end;
+};
+
+struct polyfile_scan {
+    const struct polyfile *f;
+    int flags;
+    polyfile_scan_fn fn;
+    void *arg;
+    /* the errno of the first range to fail, stopping the others */
+    int error;
+};
+
+static void *
+polyfile_scan_range(void *arg)
+{
+    struct polyfile_range *r = arg;
+    struct polyfile_scan *scan = r->scan;
+    const char *const data = scan->f->data;
+    polyad_t p = NULL;
+    size_t off, record, n;
+    int error = 0;
+    for (off = r->start, record = r->record; off < r->end; off += n, record++) {
+        if (__atomic_load_n(&scan->error, __ATOMIC_RELAXED)) {
+            break;
+        }
+        /* the first polyad takes the load flags, that reloads keep */
+        errno = 0;
+        n = p ? polyad_reload(data + off, r->end - off, &p) :
+                polyad_load_ex(data + off, r->end - off, scan->flags, NULL, 0, &p);
+        if (n) {
+            /* the whole polyad, of which a lazy load reads only the header */
+            n = polyad_size(p);
+            if (n > r->end - off) {
+                n = 0;
+                errno = EINVAL;
+            }
+        }
+        if (!n || !scan->fn(scan->arg, r->range, record, off, p)) {
+            error = errno ? errno : EINVAL;
+            break;
+        }
+    }
+    if (!error && off >= r->end) {
+        errno = 0;
+        if (!scan->fn(scan->arg, r->range, record, off, NULL)) {
+            error = errno ? errno : EINVAL;
+        }
+    }
+    if (error) {
+        int none = 0;
+        __atomic_compare_exchange_n(&scan->error, &none, error, 0,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    polyad_free(p);
+    return NULL;
+}
+
+int
+polyfile_scan(const struct polyfile *f, const struct polyindex *ix, size_t threads,
+        int flags, polyfile_scan_fn fn, void *arg)
+{
+    struct polyfile_scan scan = { f, flags, fn, arg, 0 };
+    struct polyfile_range *ranges;
+    struct polyindex built;
+    size_t count, lo, hi, mid, pos, k, j;
+    char *started;
+    if (!threads) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (!ix) {
+        if (!polyindex_init(&built, POLYFILE_SCAN_STRIDE) || !polyindex_build(&built, f)) {
+            polyindex_free(&built);
+            return 0;
+        }
+        ix = &built;
+    }
+    count = ix->records ? (ix->records - 1) / ix->stride + 1 : 0;
+    if (count && ix->offsets[count - 1] > f->size) {
+        errno = EINVAL;
+        ranges = NULL;
+    } else {
+        ranges = calloc(threads, sizeof(*ranges) + 1);
+    }
+    if (!ranges) {
+        if (ix == &built) {
+            polyindex_free(&built);
+        }
+        return 0;
+    }
+    started = (char *) (ranges + threads);
+
+    /* each range starts at the first indexed record from its share of the file */
+    for (k = 0, j = 0; k < threads; k++) {
+        pos = f->size / threads * k + f->size % threads * k / threads;
+        lo = j;
+        hi = count;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (ix->offsets[mid] < pos) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        j = k ? lo : 0;
+        ranges[k].scan = &scan;
+        ranges[k].range = k;
+        ranges[k].record = j * ix->stride;
+        ranges[k].start = j < count ? ix->offsets[j] : k ? f->size : 0;
+        if (k) {
+            ranges[k - 1].end = ranges[k].start;
+        }
+    }
+    ranges[threads - 1].end = f->size;
+    if (ix == &built) {
+        polyindex_free(&built);
+    }
+
+    /* a range whose thread fails to start is scanned by the calling thread */
+    for (k = 1; k < threads; k++) {
+        started[k] = !pthread_create(&ranges[k].thread, NULL, polyfile_scan_range, &ranges[k]);
+    }
+    polyfile_scan_range(&ranges[0]);
+    for (k = 1; k < threads; k++) {
+        if (started[k]) {
+            pthread_join(ranges[k].thread, NULL);
+        } else {
+            polyfile_scan_range(&ranges[k]);
+        }
+    }
+    free(ranges);
+    if (scan.error) {
+        errno = scan.error;
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,237 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _polyfile_h_DEFINED
+#define _polyfile_h_DEFINED
+
+#include <sys/types.h>
+#include "ntuple.h"
+#include "polyad.h"
+
+/**
+ * polyfile - polyads stored back to back in a file, read in place from a
+ * read-only memory mapping
+ */
+struct polyfile {
+    const void *data;
+    size_t size;
+};
+
+/** Mapping advice: the file is read in order ({@code MADV_SEQUENTIAL}) **/
+#define POLYFILE_SEQUENTIAL 0x1
+/** Mapping advice: the whole file is read soon ({@code MADV_WILLNEED}) **/
+#define POLYFILE_WILLNEED 0x2
+
+/**
+ * Map a file for reading its polyads in place.
+ *
+ * The mapping is independent of {@code fd}, which may be closed.  An empty
+ * file is mapped with NULL data.
+ *
+ * @param fd a file descriptor open for reading
+ * @param advice the mapping advice, a combination of
+ *               {@code POLYFILE_SEQUENTIAL} and {@code POLYFILE_WILLNEED}
+ * @param f the file mapping to initialize
+ * @return 1 on success, 0 on error
+ * @error EBADF, EACCES, ENODEV, ENOMEM see {@code fstat(2)} and {@code mmap(2)}
+ * @error EFBIG the file is too large to map
+ */
+int    polyfile_map(int fd, int advice, struct polyfile *f);
+
+/**
+ * Unmap a file, which must no longer be referred to by any polyad.
+ */
+void   polyfile_unmap(struct polyfile *f);
+
+/**
+ * Read the next polyad of a file, reusing the polyad at {@code *p} (see
+ * {@code polyad_reload}).
+ *
+ * @param f the file mapping
+ * @param off the address of the offset of the next polyad, which is
+ *            advanced past it
+ * @param p the address of a polyad pointer to reuse and update
+ * @return the size of the polyad, 0 at the end of the file (with
+ *         {@code *off} equal to the file size) or on error
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL the file ends within the polyad
+ * @error ENOMEM memory allocation failure
+ */
+size_t polyfile_next(const struct polyfile *f, size_t *off, polyad_t *p);
+
+/**
+ * A sparse index of the polyads of a file: the offset of every
+ * {@code stride}-th record, so that a record is found from the nearest
+ * one indexed before it by skipping at most {@code stride - 1} records.
+ */
+struct polyindex {
+    /* the number of records between indexed records */
+    size_t stride;
+    /* the number of records indexed */
+    size_t records;
+    /* the end offset of the last record indexed */
+    size_t size;
+    /* the offset of each record indexed, and the space allocated for them */
+    size_t *offsets;
+    size_t capacity;
+};
+
+/**
+ * The worst-case packed size of an index, see {@code polyindex_pack}
+ */
+#define POLYINDEX_MAX_SIZE(ix) \
+    (NTUPLE_MAX_SIZE(3) + NTUPLE_MAX_SIZE(((ix)->records + (ix)->stride - 1) / (ix)->stride))
+
+/**
+ * Initialize an empty index.
+ *
+ * @param ix the index
+ * @param stride the number of records between indexed records
+ * @return 1 on success, 0 on error
+ * @error EINVAL {@code stride} is 0
+ */
+int    polyindex_init(struct polyindex *ix, size_t stride);
+
+/**
+ * Add a record to an index, as it is written after those already added.
+ *
+ * @param ix the index
+ * @param off the offset of the record, at least {@code ix->size}
+ * @param size the size of the record
+ * @return 1 on success, 0 on error
+ * @error EINVAL {@code off} precedes the end of the last record
+ * @error ENOMEM memory allocation failure
+ */
+int    polyindex_add(struct polyindex *ix, size_t off, size_t size);
+
+/**
+ * Add the records of a file following those already indexed to an index,
+ * in one pass without loading them.
+ *
+ * @param ix the index
+ * @param f the file mapping
+ * @return 1 on success, 0 on error
+ * @error ERANGE, EINVAL a record is invalid (see {@code polyad_span})
+ * @error ENOMEM memory allocation failure
+ */
+int    polyindex_build(struct polyindex *ix, const struct polyfile *f);
+
+/**
+ * Pack an index as an ntuple of its stride, record count and size, then
+ * an ntuple of its offsets with {@code NTUPLE_DELTA}.
+ *
+ * @param ix the index
+ * @param dst the destination buffer
+ * @param len the size of the destination buffer, see {@code POLYINDEX_MAX_SIZE}
+ * @return the number of bytes written to {@code dst}, 0 on error
+ * @error EINVAL {@code len} is too small
+ */
+size_t polyindex_pack(const struct polyindex *ix, void *dst, size_t len);
+
+/**
+ * Initialize an index from packed form.
+ *
+ * @param src a pointer to the read buffer
+ * @param len the buffer size
+ * @param ix the uninitialized index
+ * @return the number of bytes read, 0 on error
+ * @error ERANGE a stored varint would overflow the {@code size_t} of this architecture
+ * @error EINVAL the buffer does not hold a valid index
+ * @error ENOMEM memory allocation failure
+ */
+size_t polyindex_load(const void *src, size_t len, struct polyindex *ix);
+
+/**
+ * Free the offsets of an index.
+ */
+void   polyindex_free(struct polyindex *ix);
+
+/**
+ * Find a record of a file by number, from the nearest record indexed
+ * before it.
+ *
+ * @param ix the index, or NULL to skip records from the start of the file
+ * @param f the file mapping
+ * @param record the record number
+ * @param off the address to store the offset of the record, which is the
+ *            file size for the record following the last
+ * @return 1 on success, 0 on error
+ * @error EINVAL the file holds fewer records, or a record is invalid
+ * @error ERANGE a record is invalid (see {@code polyad_span})
+ */
+int    polyindex_seek(const struct polyindex *ix, const struct polyfile *f, size_t record,
+        size_t *off);
+
+/**
+ * Find the first record of a file starting at or after an offset.
+ *
+ * @param ix the index, or NULL to skip records from the start of the file
+ * @param f the file mapping
+ * @param pos the file offset
+ * @param record the address to store the record number
+ * @param off the address to store the offset of the record, which is the
+ *            file size if none follows {@code pos}
+ * @return 1 on success, 0 on error
+ * @error EINVAL, ERANGE a record is invalid (see {@code polyad_span})
+ */
+int    polyindex_find(const struct polyindex *ix, const struct polyfile *f, size_t pos,
+        size_t *record, size_t *off);
+
+/** The stride of the index {@code polyfile_scan} builds when given none **/
+#define POLYFILE_SCAN_STRIDE 1024
+
+/**
+ * The callback of {@code polyfile_scan}, called in order for each record
+ * of a range, then once with a NULL polyad at the end of the range.
+ * Callbacks for different ranges run concurrently.
+ *
+ * @param arg the argument given to {@code polyfile_scan}
+ * @param range the range number
+ * @param record the record number
+ * @param off the record offset, or the end offset of the range
+ * @param p the polyad loaded from the record, valid until the callback
+ *          returns, or NULL at the end of the range
+ * @return 1 to continue, 0 to stop the scan on error, setting errno
+ */
+typedef int (*polyfile_scan_fn)(void *arg, size_t range, size_t record, size_t off,
+        polyad_t p);
+
+/**
+ * Scan the polyads of a file on several threads, each loading those of
+ * one range of the file.
+ *
+ * The file is split into {@code threads} ranges of about the same size,
+ * starting at indexed records (some ranges may be empty, when the file
+ * holds few indexed records).  The calling thread scans the first range.
+ *
+ * @param f the file mapping
+ * @param ix the index of the file, or NULL to build one first (see
+ *           {@code polyindex_build}, with {@code POLYFILE_SCAN_STRIDE})
+ * @param threads the number of ranges and threads
+ * @param flags the load flags (see {@code polyad_load_ex})
+ * @param fn the callback
+ * @param arg the callback argument
+ * @return 1 on success, 0 on error, stopping all ranges at the next record
+ * @error EINVAL {@code threads} is 0, or the index exceeds the file
+ * @error ERANGE, EINVAL, ENOMEM a record is invalid (see {@code polyad_load_ex})
+ * @error any error of a callback
+ */
+int    polyfile_scan(const struct polyfile *f, const struct polyindex *ix, size_t threads,
+        int flags, polyfile_scan_fn fn, void *arg);
+
+#endif /* _polyfile_h_DEFINED */
@@ -0,0 +1,533 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include "polyadobject.h"
+#include "polyfileobject.h"
+#include "polyadicts_inline.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * PyPolyfile
+ */
+
+void
+PyPolyfile_dealloc(PyPolyfile* self)
+{
+    if (self->mapped)
+        polyfile_unmap(&self->file);
+    if (self->indexed)
+        polyindex_free(&self->index);
+    self->ob_base.ob_type->tp_free((PyObject*)self);
+}
+
+PyObject *
+PyPolyfile_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "verify", "trust", "willneed", "index", NULL};
+    PyObject *src, *path = NULL, *index = Py_None;
+    int verify = 0, trust = 0, willneed = 0;
+    int fd, ok;
+    Py_buffer view;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$pppO:polyfile", kwlist,
+            &src, &verify, &trust, &willneed, &index))
+        return NULL;
+
+    PyPolyfile *self = (PyPolyfile*) type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->flags = (verify ? POLYAD_VERIFY : 0) | (trust ? POLYAD_TRUST : 0);
+    if (verify && trust) {
+        PyErr_SetString(PyExc_ValueError, "verify and trust are exclusive");
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    /* map a file descriptor, or a file opened by path */
+    if (PyLong_Check(src)) {
+        fd = PyLong_AsLong(src);
+        if (fd == -1 && PyErr_Occurred()) {
+            Py_DECREF(self);
+            return NULL;
+        }
+    } else if (PyUnicode_FSConverter(src, &path)) {
+        Py_BEGIN_ALLOW_THREADS
+        fd = open(PyBytes_AS_STRING(path), O_RDONLY | O_CLOEXEC);
+        Py_END_ALLOW_THREADS
+        if (fd < 0) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, src);
+            Py_DECREF(path);
+            Py_DECREF(self);
+            return NULL;
+        }
+    } else {
+        Py_DECREF(self);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ok = polyfile_map(fd, POLYFILE_SEQUENTIAL | (willneed ? POLYFILE_WILLNEED : 0),
+            &self->file);
+    if (path)
+        close(fd);
+    Py_END_ALLOW_THREADS
+    Py_XDECREF(path);
+    if (!ok) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(self);
+        return NULL;
+    }
+    self->mapped = 1;
+
+    /* load an index packed by polyfile.index() or polylog.index() */
+    if (index != Py_None) {
+        if (PyObject_GetBuffer(index, &view, PyBUF_SIMPLE)) {
+            Py_DECREF(self);
+            return NULL;
+        }
+        ok = polyindex_load(view.buf, view.len, &self->index) != 0;
+        PyBuffer_Release(&view);
+        if (!ok) {
+            PyPolyad_SetErrFromErrno();
+            Py_DECREF(self);
+            return NULL;
+        }
+        self->indexed = 1;
+        if (self->index.size > self->file.size) {
+            PyErr_SetString(PyExc_ValueError, "index exceeds the file");
+            Py_DECREF(self);
+            return NULL;
+        }
+    }
+    return (PyObject*) self;
+}
+
+static int
+_polyfile_check(PyPolyfile *self)
+{
+    if (!self->mapped) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed polyfile");
+        return 0;
+    }
+    return 1;
+}
+
+static PyObject *
+PyPolyfile_close(PyPolyfile *self, PyObject *unused)
+{
+    if (self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError, "cannot close: polyads refer to the mapping");
+        return NULL;
+    }
+    if (self->users > 0) {
+        PyErr_SetString(PyExc_BufferError, "cannot close: the mapping is in use");
+        return NULL;
+    }
+    if (self->mapped) {
+        polyfile_unmap(&self->file);
+        self->mapped = 0;
+    }
+    if (self->indexed) {
+        polyindex_free(&self->index);
+        self->indexed = 0;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyPolyfile_tell(PyPolyfile *self, PyObject *unused)
+{
+    if (!_polyfile_check(self))
+        return NULL;
+    return PyLong_FromSize_t(self->offset);
+}
+
+static PyObject *
+PyPolyfile_index(PyPolyfile *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"stride", NULL};
+    Py_ssize_t stride = 1024;
+    PyObject *res;
+    int ok;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|n:index", kwlist, &stride))
+        return NULL;
+    if (!_polyfile_check(self))
+        return NULL;
+    if (stride <= 0) {
+        PyErr_SetString(PyExc_ValueError, "stride must be positive");
+        return NULL;
+    }
+    if (self->users > 0) {
+        PyErr_SetString(PyExc_BufferError, "cannot index: the index is in use");
+        return NULL;
+    }
+
+    /* extend an index of the same stride, or scan the file anew */
+    if (self->indexed && self->index.stride != (size_t) stride) {
+        polyindex_free(&self->index);
+        self->indexed = 0;
+    }
+    if (!self->indexed) {
+        polyindex_init(&self->index, stride);
+        self->indexed = 1;
+    }
+    /* the user count keeps the mapping and index from changing meanwhile */
+    self->users++;
+    Py_BEGIN_ALLOW_THREADS
+    ok = polyindex_build(&self->index, &self->file);
+    Py_END_ALLOW_THREADS
+    self->users--;
+    if (!ok) {
+        PyPolyad_SetErrFromErrno();
+        return NULL;
+    }
+
+    res = PyBytes_FromStringAndSize(NULL, POLYINDEX_MAX_SIZE(&self->index));
+    if (!res)
+        return NULL;
+    _PyBytes_Resize(&res, polyindex_pack(&self->index, PyBytes_AS_STRING(res),
+            PyBytes_GET_SIZE(res)));
+    return res;
+}
+
+static PyObject *
+PyPolyfile_seek(PyPolyfile *self, PyObject *arg)
+{
+    size_t record, off;
+    int ok;
+    record = PyLong_AsSize_t(arg);
+    if (record == (size_t) -1 && PyErr_Occurred())
+        return NULL;
+    if (!_polyfile_check(self))
+        return NULL;
+    self->users++;
+    Py_BEGIN_ALLOW_THREADS
+    ok = polyindex_seek(self->indexed ? &self->index : NULL, &self->file, record, &off);
+    Py_END_ALLOW_THREADS
+    self->users--;
+    if (!ok) {
+        if (errno == EINVAL)
+            PyErr_SetString(PyExc_IndexError, "polyfile record out of range");
+        else
+            PyPolyad_SetErrFromErrno();
+        return NULL;
+    }
+    self->record = record;
+    self->offset = off;
+    return PyLong_FromSize_t(off);
+}
+
+static PyObject *
+PyPolyfile_find(PyPolyfile *self, PyObject *arg)
+{
+    size_t pos, record, off;
+    int ok;
+    pos = PyLong_AsSize_t(arg);
+    if (pos == (size_t) -1 && PyErr_Occurred())
+        return NULL;
+    if (!_polyfile_check(self))
+        return NULL;
+    self->users++;
+    Py_BEGIN_ALLOW_THREADS
+    ok = polyindex_find(self->indexed ? &self->index : NULL, &self->file, pos,
+            &record, &off);
+    Py_END_ALLOW_THREADS
+    self->users--;
+    if (!ok) {
+        PyPolyad_SetErrFromErrno();
+        return NULL;
+    }
+    self->record = record;
+    self->offset = off;
+    return PyLong_FromSize_t(record);
+}
+
+/* The number of records each range loads between calls to the reducer */
+#define _POLYFILE_SCAN_BATCH 256
+
+struct _polyfile_scan {
+    PyPolyfile *self;
+    PyObject *reducer;
+    /* the accumulator of each range */
+    PyObject *accs;
+    /* the offsets of the records loaded by each range, not yet reduced */
+    size_t *batch;
+    size_t *batched;
+    /* the exception of the first reducer to fail, raised by scan() */
+    PyObject *type, *value, *traceback;
+};
+
+/* Reduce the records batched by a range, taking the GIL */
+static int
+_polyfile_scan_flush(struct _polyfile_scan *scan, size_t range)
+{
+    const size_t *batch = scan->batch + range * _POLYFILE_SCAN_BATCH;
+    PyGILState_STATE gil;
+    PyObject *acc, *pack;
+    Py_buffer view;
+    size_t i;
+    int flags, ok = 1;
+    gil = PyGILState_Ensure();
+    /* records of a verified file were verified by the range, and are trusted now */
+    flags = scan->self->flags;
+    if (flags & POLYAD_VERIFY)
+        flags = (flags & ~POLYAD_VERIFY) | POLYAD_TRUST;
+    for (i = 0; ok && i < scan->batched[range]; i++) {
+        /* each polyad shares an export of the mapping */
+        pack = NULL;
+        if (!PyObject_GetBuffer((PyObject*)scan->self, &view, PyBUF_SIMPLE)) {
+            pack = PyPolyad_FromBuffer(&view, batch[i], 0, flags);
+            if (!pack)
+                PyBuffer_Release(&view);
+        }
+        acc = pack ? PyObject_CallFunctionObjArgs(scan->reducer,
+                PyList_GET_ITEM(scan->accs, range), pack, NULL) : NULL;
+        Py_XDECREF(pack);
+        if (acc) {
+            PyList_SetItem(scan->accs, range, acc);
+        } else {
+            ok = 0;
+        }
+    }
+    scan->batched[range] = 0;
+    if (!ok) {
+        /* the thread state of a scanning thread does not outlive it */
+        if (scan->type)
+            PyErr_Clear();
+        else
+            PyErr_Fetch(&scan->type, &scan->value, &scan->traceback);
+    }
+    PyGILState_Release(gil);
+    if (!ok)
+        errno = ECANCELED;
+    return ok;
+}
+
+static int
+_polyfile_scan_record(void *arg, size_t range, size_t record, size_t off, polyad_t p)
+{
+    struct _polyfile_scan *scan = arg;
+    if (p) {
+        scan->batch[range * _POLYFILE_SCAN_BATCH + scan->batched[range]++] = off;
+        if (scan->batched[range] < _POLYFILE_SCAN_BATCH)
+            return 1;
+    }
+    return _polyfile_scan_flush(scan, range);
+}
+
+static PyObject *
+PyPolyfile_scan(PyPolyfile *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "initial", "threads", NULL};
+    struct _polyfile_scan scan;
+    PyObject *initial = Py_None;
+    Py_ssize_t threads = 0, k;
+    int ok;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O$n:scan", kwlist,
+            &scan.reducer, &initial, &threads))
+        return NULL;
+    if (!_polyfile_check(self))
+        return NULL;
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+
+    scan.self = self;
+    scan.type = scan.value = scan.traceback = NULL;
+    scan.accs = PyList_New(threads);
+    if (!scan.accs)
+        return NULL;
+    for (k = 0; k < threads; k++) {
+        Py_INCREF(initial);
+        PyList_SET_ITEM(scan.accs, k, initial);
+    }
+    scan.batch = PyMem_RawMalloc(threads * sizeof(size_t) * (_POLYFILE_SCAN_BATCH + 1));
+    if (!scan.batch) {
+        Py_DECREF(scan.accs);
+        return PyErr_NoMemory();
+    }
+    scan.batched = scan.batch + threads * _POLYFILE_SCAN_BATCH;
+    memset(scan.batched, 0, threads * sizeof(size_t));
+
+    /* the user count keeps the mapping and index from changing by a reducer */
+    self->users++;
+    Py_BEGIN_ALLOW_THREADS
+    ok = polyfile_scan(&self->file, self->indexed ? &self->index : NULL, threads,
+            self->flags, _polyfile_scan_record, &scan);
+    Py_END_ALLOW_THREADS
+    self->users--;
+    PyMem_RawFree(scan.batch);
+    if (!ok) {
+        /* the exception of a reducer, or of the file */
+        if (scan.type)
+            PyErr_Restore(scan.type, scan.value, scan.traceback);
+        else
+            PyPolyad_SetErrFromErrno();
+        Py_DECREF(scan.accs);
+        return NULL;
+    }
+    return scan.accs;
+}
+
+static PyObject *
+PyPolyfile_enter(PyPolyfile *self, PyObject *unused)
+{
+    if (!_polyfile_check(self))
+        return NULL;
+    Py_INCREF(self);
+    return (PyObject*) self;
+}
+
+static PyObject *
+PyPolyfile_exit(PyPolyfile *self, PyObject *args)
+{
+    return PyPolyfile_close(self, NULL);
+}
+
+static PyMethodDef PyPolyfile_methods[] = {
+    {"close", (PyCFunction)PyPolyfile_close, METH_NOARGS,
+     "Unmap the file, once no polyad refers to it"},
+    {"tell", (PyCFunction)PyPolyfile_tell, METH_NOARGS,
+     "The offset of the next polyad to iterate"},
+    {"index", (PyCFunction)PyPolyfile_index, METH_VARARGS | METH_KEYWORDS,
+     "index(stride=1024)\n\n"
+     "Index every stride-th polyad of the file, and return the index packed\n"
+     "for polyfile(..., index=)"},
+    {"seek", (PyCFunction)PyPolyfile_seek, METH_O,
+     "seek(record)\n\n"
+     "Iterate from a polyad by number, and return its offset"},
+    {"find", (PyCFunction)PyPolyfile_find, METH_O,
+     "find(offset)\n\n"
+     "Iterate from the first polyad at or after an offset, and return its number"},
+    {"scan", (PyCFunction)PyPolyfile_scan, METH_VARARGS | METH_KEYWORDS,
+     "scan(reducer, initial=None, *, threads=0)\n\n"
+     "Reduce the polyads of the file split into ranges, loaded (and verified,\n"
+     "if the file is) concurrently by threads (by default, one per CPU), and\n"
+     "return the list of accumulators of the ranges, each folded from initial\n"
+     "as reducer(accumulator, polyad) with the GIL held."},
+    {"__enter__", (PyCFunction)PyPolyfile_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)PyPolyfile_exit, METH_VARARGS, NULL},
+    {NULL}  /* Sentinel */
+};
+
+/* PyPolyfile buffer API */
+int
+PyPolyfile_getbuffer(PyPolyfile *self, Py_buffer *view, int flags)
+{
+    if (!_polyfile_check(self)) {
+        view->obj = NULL;
+        return -1;
+    }
+    if (PyBuffer_FillInfo(view, (PyObject*)self,
+            (void *) (self->file.data ? self->file.data : ""), self->file.size,
+            1, flags)) {
+        return -1;
+    }
+    self->exports++;
+    return 0;
+}
+
+void
+PyPolyfile_releasebuffer(PyPolyfile *self, Py_buffer *view)
+{
+    self->exports--;
+}
+
+PyBufferProcs PyPolyfile_as_buffer = {
+    (getbufferproc)PyPolyfile_getbuffer,
+    (releasebufferproc)PyPolyfile_releasebuffer,
+};
+
+/* PyPolyfile iterator API */
+PyObject *
+PyPolyfile_iternext(PyPolyfile *self)
+{
+    Py_buffer view;
+    PyPolyad *pack;
+    size_t size;
+    if (!_polyfile_check(self) || self->offset >= self->file.size)
+        return NULL;
+
+    /* each polyad shares an export of the mapping */
+    if (PyObject_GetBuffer((PyObject*)self, &view, PyBUF_SIMPLE))
+        return NULL;
+    pack = (PyPolyad*) PyPolyad_FromBuffer(&view, self->offset, 0, self->flags);
+    if (!pack) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    /* a polyad is only known to be whole once sized, if lazy or trusted */
+    size = polyad_size_inline(pack->polyad);
+    if (!size || size > self->file.size - self->offset) {
+        if (size)
+            errno = EINVAL;
+        PyPolyad_SetErrFromErrno();
+        Py_DECREF(pack);
+        return NULL;
+    }
+    self->offset += size;
+    self->record++;
+    return (PyObject*) pack;
+}
+
+/* PyPolyfile type definition */
+PyTypeObject PyPolyfile_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "polyadicts.polyfile",      /*tp_name*/
+    sizeof(PyPolyfile),         /*tp_basicsize*/
+    0,                          /*tp_itemsize*/
+    (destructor)PyPolyfile_dealloc, /*tp_dealloc*/
+    0,                          /*tp_print*/
+    0,                          /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    0,                          /*tp_repr*/
+    0,                          /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    &PyPolyfile_as_buffer,      /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    "polyfile(path | fd, *, verify=False, trust=False, willneed=False, index=None)\n\n"
+    "An iterator over the polyads stored back to back in a file, read in\n"
+    "place from a memory mapping that they share.  An index packed by\n"
+    "index() makes seek() and find() skip at most its stride of polyads.", /* tp_doc */
+    0,                          /* tp_traverse */
+    0,                          /* tp_clear */
+    0,                          /* tp_richcompare */
+    0,                          /* tp_weaklistoffset */
+    PyObject_SelfIter,          /* tp_iter */
+    (iternextfunc)PyPolyfile_iternext, /* tp_iternext */
+    PyPolyfile_methods,         /* tp_methods */
+    0,                          /* tp_members */
+    0,                          /* tp_getset */
+    0,                          /* tp_base */
+    0,                          /* tp_dict */
+    0,                          /* tp_descr_get */
+    0,                          /* tp_descr_set */
+    0,                          /* tp_dictoffset */
+    0,                          /* tp_init */
+    0,                          /* tp_alloc */
+    PyPolyfile_tp_new,          /* tp_new */
+};
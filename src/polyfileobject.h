@@ -0,0 +1,60 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _polyfileobject_h_DEFINED
+#define _polyfileobject_h_DEFINED
+
+#include <Python.h>
+#include "polyfile.h"
+
+typedef struct PyPolyfile_st
+{
+    PyObject_HEAD
+    /* underlying C file mapping */
+    struct polyfile file;
+    /* whether the file is mapped, i.e. not closed */
+    int mapped;
+    /* load flags of the polyads iterated */
+    int flags;
+    /* the offset and number of the next polyad to iterate */
+    size_t offset;
+    size_t record;
+    /* the sparse index of the records, if any */
+    struct polyindex index;
+    int indexed;
+    /* the number of buffers exported from the mapping */
+    Py_ssize_t exports;
+    /* the number of calls reading the mapping and index without the GIL */
+    Py_ssize_t users;
+} PyPolyfile;
+
+PyAPI_FUNC(void) PyPolyfile_dealloc(PyPolyfile* self);
+PyAPI_FUNC(PyObject *) PyPolyfile_tp_new(PyTypeObject *type, PyObject *args,
+        PyObject *kwds);
+
+/* PyPolyfile buffer API */
+PyAPI_FUNC(int) PyPolyfile_getbuffer(PyPolyfile *self, Py_buffer *view, int flags);
+PyAPI_FUNC(void) PyPolyfile_releasebuffer(PyPolyfile *self, Py_buffer *view);
+
+/* PyPolyfile iterator API */
+PyAPI_FUNC(PyObject *) PyPolyfile_iternext(PyPolyfile *self);
+
+/* PyPolyfile type definition */
+PyAPI_DATA(PyTypeObject) PyPolyfile_Type;
+
+#endif
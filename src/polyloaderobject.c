@@ -0,0 +1,237 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include "polyadobject.h"
+#include "polyloaderobject.h"
+#include "polyadicts_inline.h"
+#include <errno.h>
+#include <stddef.h>
+
+/* The size of the first slab of a loader, and the greatest it doubles to */
+#define POLYLOADER_SLAB_MIN (16 * 1024)
+#define POLYLOADER_SLAB_MAX (1024 * 1024)
+
+/**
+ * PyPolyslab
+ */
+
+static void
+PyPolyslab_dealloc(PyPolyslab *self)
+{
+    Py_XDECREF(self->source);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* PyPolyslab type definition */
+PyTypeObject PyPolyslab_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "polyadicts.polyslab",      /*tp_name*/
+    offsetof(PyPolyslab, mem),  /*tp_basicsize*/
+    sizeof(size_t),             /*tp_itemsize*/
+    (destructor)PyPolyslab_dealloc, /*tp_dealloc*/
+    0,                          /*tp_print*/
+    0,                          /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    0,                          /*tp_repr*/
+    0,                          /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    0,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    "The storage of polyads loaded together", /* tp_doc */
+};
+
+/**
+ * PyPolyloader
+ */
+
+PyObject *
+PyPolyloader_New(PyObject *src, int flags)
+{
+    PyPolyloader *self;
+    PyObject *source;
+    if ((flags & POLYAD_VERIFY) && (flags & POLYAD_TRUST)) {
+        PyErr_SetString(PyExc_ValueError, "verify and trust are exclusive");
+        return NULL;
+    }
+
+    /* one export of the buffer, shared by every polyad loaded from it */
+    source = PyMemoryView_FromObject(src);
+    if (!source)
+        return NULL;
+    if (!PyBuffer_IsContiguous(PyMemoryView_GET_BUFFER(source), 'C')) {
+        PyErr_SetString(PyExc_TypeError, "expected a contiguous buffer");
+        Py_DECREF(source);
+        return NULL;
+    }
+    self = PyObject_New(PyPolyloader, &PyPolyloader_Type);
+    if (!self) {
+        Py_DECREF(source);
+        return NULL;
+    }
+    self->source = source;
+    self->flags = flags;
+    self->offset = 0;
+    self->slab = NULL;
+    self->loaded = NULL;
+    self->count = self->next = 0;
+    self->slabsize = POLYLOADER_SLAB_MIN;
+    return (PyObject*) self;
+}
+
+void
+PyPolyloader_dealloc(PyPolyloader *self)
+{
+    Py_XDECREF(self->slab);
+    Py_XDECREF(self->source);
+    PyMem_Free(self->loaded);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* Load the next slab of polyads, returning 0 with an exception */
+static int
+_polyloader_load(PyPolyloader *self)
+{
+    const Py_buffer *view = PyMemoryView_GET_BUFFER(self->source);
+    PyPolyslab *slab;
+    polyad_t *loaded;
+    size_t cap, n, off, need;
+
+    Py_CLEAR(self->slab);
+    self->count = self->next = 0;
+    if (self->offset >= (size_t) view->len)
+        return 1;
+    for (;;) {
+        cap = self->slabsize / POLYAD_SIZEOF(0);
+        loaded = PyMem_Realloc(self->loaded, cap * sizeof(polyad_t));
+        if (!loaded) {
+            PyErr_NoMemory();
+            return 0;
+        }
+        self->loaded = loaded;
+        slab = PyObject_NewVar(PyPolyslab, &PyPolyslab_Type,
+                self->slabsize / sizeof(size_t));
+        if (!slab)
+            return 0;
+        Py_INCREF(self->source);
+        slab->source = self->source;
+
+        n = cap;
+        errno = 0;
+        off = polyad_load_many((const char *) view->buf + self->offset,
+                view->len - self->offset, self->flags, slab->mem, self->slabsize,
+                loaded, &n);
+        if (n || errno != ENOMEM)
+            break;
+
+        /* a polyad larger than the slab, or one too large to be stored */
+        Py_DECREF(slab);
+        need = polyad_sizeof((const char *) view->buf + self->offset,
+                view->len - self->offset);
+        if (!need || need > PY_SSIZE_T_MAX / 2 || self->slabsize > PY_SSIZE_T_MAX / 2) {
+            PyErr_NoMemory();
+            return 0;
+        }
+        self->slabsize = need > 2 * self->slabsize ? need : 2 * self->slabsize;
+    }
+    if (!n) {
+        /* the rest of the buffer does not start with a whole polyad */
+        Py_DECREF(slab);
+        return 1;
+    }
+    self->slab = slab;
+    self->count = n;
+    self->offset += off;
+    if (self->slabsize < POLYLOADER_SLAB_MAX)
+        self->slabsize *= 2;
+    return 1;
+}
+
+/* The offset of the next polyad to iterate */
+static size_t
+_polyloader_tell(PyPolyloader *self)
+{
+    const Py_buffer *view;
+    if (self->next == self->count)
+        return self->offset;
+    view = PyMemoryView_GET_BUFFER(self->source);
+    return (const char *) polyad_data(self->loaded[self->next]) - (const char *) view->buf;
+}
+
+static PyObject *
+PyPolyloader_tell(PyPolyloader *self, PyObject *unused)
+{
+    return PyLong_FromSize_t(_polyloader_tell(self));
+}
+
+static PyMethodDef PyPolyloader_methods[] = {
+    {"tell", (PyCFunction)PyPolyloader_tell, METH_NOARGS,
+     "The offset of the next polyad to iterate, or of the bytes left unloaded\n"
+     "once the iteration stops"},
+    {NULL}  /* Sentinel */
+};
+
+/* PyPolyloader iterator API */
+PyObject *
+PyPolyloader_iternext(PyPolyloader *self)
+{
+    if (self->next == self->count && !_polyloader_load(self))
+        return NULL;
+    if (self->next == self->count)
+        return NULL;
+    return PyPolyad_FromOwner(self->loaded[self->next++], (PyObject*)self->slab);
+}
+
+/* PyPolyloader type definition */
+PyTypeObject PyPolyloader_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "polyadicts.polyloader",    /*tp_name*/
+    sizeof(PyPolyloader),       /*tp_basicsize*/
+    0,                          /*tp_itemsize*/
+    (destructor)PyPolyloader_dealloc, /*tp_dealloc*/
+    0,                          /*tp_print*/
+    0,                          /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    0,                          /*tp_repr*/
+    0,                          /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    0,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    "An iterator over the polyads stored back to back in a buffer, loaded\n"
+    "in slabs that share one export of the buffer, see iter_load().", /* tp_doc */
+    0,                          /* tp_traverse */
+    0,                          /* tp_clear */
+    0,                          /* tp_richcompare */
+    0,                          /* tp_weaklistoffset */
+    PyObject_SelfIter,          /* tp_iter */
+    (iternextfunc)PyPolyloader_iternext, /* tp_iternext */
+    PyPolyloader_methods,       /* tp_methods */
+};
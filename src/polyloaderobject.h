@@ -0,0 +1,63 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _polyloaderobject_h_DEFINED
+#define _polyloaderobject_h_DEFINED
+
+#include <Python.h>
+#include "polyad.h"
+
+/* A block of polyads loaded together, owned by each of them */
+typedef struct PyPolyslab_st
+{
+    PyObject_VAR_HEAD
+    /* the memoryview exporting the data of the polyads */
+    PyObject *source;
+    /* the storage of the polyads */
+    size_t mem[1];
+} PyPolyslab;
+
+typedef struct PyPolyloader_st
+{
+    PyObject_HEAD
+    /* the memoryview exporting the buffer, shared by the slabs */
+    PyObject *source;
+    /* load flags of the polyads */
+    int flags;
+    /* the offset of the polyads not yet loaded */
+    size_t offset;
+    /* the slab of the polyads loaded and not yet iterated */
+    PyPolyslab *slab;
+    polyad_t *loaded;
+    size_t count;
+    size_t next;
+    /* the size of the next slab */
+    size_t slabsize;
+} PyPolyloader;
+
+PyAPI_FUNC(PyObject *) PyPolyloader_New(PyObject *src, int flags);
+PyAPI_FUNC(void) PyPolyloader_dealloc(PyPolyloader *self);
+
+/* PyPolyloader iterator API */
+PyAPI_FUNC(PyObject *) PyPolyloader_iternext(PyPolyloader *self);
+
+/* PyPolyslab and PyPolyloader type definitions */
+PyAPI_DATA(PyTypeObject) PyPolyslab_Type;
+PyAPI_DATA(PyTypeObject) PyPolyloader_Type;
+
+#endif
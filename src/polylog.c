@@ -0,0 +1,327 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "polylog.h"
+
+struct polylog {
+    pthread_mutex_t lock;
+    /* signalled when an I/O ends, or a commit's batch is buffered */
+    pthread_cond_t cond;
+    int fd;
+    /* the file offset of the start of the log */
+    off_t base;
+    /* the append buffers, of which the active one holds used bytes */
+    char *buf[2];
+    int active;
+    size_t used;
+    size_t bufsize;
+    size_t batch;
+    unsigned long latency;
+    /* log offsets: the end of the records appended, written and synced */
+    size_t appended;
+    size_t written;
+    size_t durable;
+    /* a thread is writing the log, or gathering a commit */
+    int busy;
+    /* the errno of a failed write or sync, failing the log */
+    int error;
+    /* the index of the records appended, if any */
+    struct polyindex *index;
+};
+
+int
+polylog_open(int fd, size_t bufsize, size_t batch, unsigned long latency,
+        struct polylog **dst)
+{
+    struct polylog *log;
+    pthread_condattr_t attr;
+    struct stat st;
+    int flags;
+    *dst = NULL;
+    if (bufsize < POLYLOG_ALIGN) {
+        errno = EINVAL;
+        return 0;
+    }
+    log = calloc(1, sizeof(*log));
+    if (!log) {
+        return 0;
+    }
+    log->buf[0] = malloc(bufsize);
+    log->buf[1] = malloc(bufsize);
+    if (!log->buf[0] || !log->buf[1]) {
+        free(log->buf[0]);
+        free(log->buf[1]);
+        free(log);
+        errno = ENOMEM;
+        return 0;
+    }
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&log->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    log->fd = fd;
+    /* blocks are aligned to the file, where it is seekable */
+    flags = fcntl(fd, F_GETFL);
+    if (flags >= 0 && flags & O_APPEND && !fstat(fd, &st)) {
+        log->base = st.st_size;
+    } else {
+        log->base = lseek(fd, 0, SEEK_CUR);
+        log->base = log->base < 0 ? 0 : log->base;
+    }
+    log->bufsize = bufsize;
+    log->batch = batch < bufsize ? batch : bufsize;
+    log->latency = latency;
+    *dst = log;
+    return 1;
+}
+
+/* Write a buffer in full, retrying partial and interrupted writes */
+static int
+polylog_write(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+    while (len) {
+        n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/*
+ * Write out the active buffer, swapping in the other for appends, then
+ * sync the file if {@code sync}: called locked by the busy thread, which
+ * it unlocks for the I/O.  Without syncing, a partial block at the end of
+ * the buffer stays buffered.
+ */
+static void
+polylog_flush(struct polylog *log, int sync)
+{
+    char *const buf = log->buf[log->active];
+    const size_t n = log->used;
+    size_t tail, end;
+    int ok, err;
+    tail = sync ? 0 : (log->base + log->written + n) % POLYLOG_ALIGN;
+    if (tail >= n) {
+        tail = 0;
+    }
+    log->active ^= 1;
+    memcpy(log->buf[log->active], buf + n - tail, tail);
+    log->used = tail;
+    end = log->written + n - tail;
+    pthread_mutex_unlock(&log->lock);
+    ok = polylog_write(log->fd, buf, n - tail) && (!sync || !fdatasync(log->fd));
+    err = errno;
+    pthread_mutex_lock(&log->lock);
+    if (ok) {
+        log->written = end;
+        if (sync) {
+            log->durable = end;
+        }
+    } else if (!log->error) {
+        log->error = err;
+    }
+    log->busy = 0;
+    pthread_cond_broadcast(&log->cond);
+}
+
+/* Index a record of {@code len} bytes being appended, called locked */
+static int
+polylog_add(struct polylog *log, size_t len)
+{
+    return !log->index || polyindex_add(log->index, log->base + log->appended, len);
+}
+
+size_t
+polylog_appendv(struct polylog *log, const struct iovec *iov, int iovcnt)
+{
+    size_t len, off;
+    int i, ok;
+    for (len = 0, i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+    if (!len) {
+        errno = EINVAL;
+        return 0;
+    }
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        if (log->error) {
+            errno = log->error;
+            pthread_mutex_unlock(&log->lock);
+            return 0;
+        }
+        if (log->used + len <= log->bufsize) {
+            break;
+        } else if (log->busy) {
+            pthread_cond_wait(&log->cond, &log->lock);
+        } else if (log->used) {
+            /* make room, writing out the buffer */
+            log->busy = 1;
+            polylog_flush(log, 0);
+        } else {
+            /* a record larger than the buffer is written directly */
+            if (!polylog_add(log, len)) {
+                pthread_mutex_unlock(&log->lock);
+                return 0;
+            }
+            log->busy = 1;
+            log->appended += len;
+            off = log->appended;
+            pthread_mutex_unlock(&log->lock);
+            for (ok = 1, i = 0; ok && i < iovcnt; i++) {
+                ok = polylog_write(log->fd, iov[i].iov_base, iov[i].iov_len);
+            }
+            pthread_mutex_lock(&log->lock);
+            if (ok) {
+                log->written += len;
+            } else if (!log->error) {
+                log->error = errno;
+            }
+            log->busy = 0;
+            pthread_cond_broadcast(&log->cond);
+            pthread_mutex_unlock(&log->lock);
+            return ok ? off : 0;
+        }
+    }
+    if (!polylog_add(log, len)) {
+        pthread_mutex_unlock(&log->lock);
+        return 0;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(log->buf[log->active] + log->used, iov[i].iov_base, iov[i].iov_len);
+        log->used += iov[i].iov_len;
+    }
+    log->appended += len;
+    off = log->appended;
+    if (log->used >= log->batch) {
+        /* end the wait of a commit gathering appenders */
+        pthread_cond_broadcast(&log->cond);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return off;
+}
+
+size_t
+polylog_append(struct polylog *log, const void *data, size_t len)
+{
+    struct iovec iov;
+    iov.iov_base = (void *) data;
+    iov.iov_len = len;
+    return polylog_appendv(log, &iov, 1);
+}
+
+int
+polylog_sync(struct polylog *log, size_t off)
+{
+    struct timespec deadline;
+    int ok;
+    pthread_mutex_lock(&log->lock);
+    off = off < log->appended ? off : log->appended;
+    while (!log->error && log->durable < off) {
+        if (log->busy) {
+            /* another commit may cover this one */
+            pthread_cond_wait(&log->cond, &log->lock);
+            continue;
+        }
+        log->busy = 1;
+        if (log->latency && log->used < log->batch) {
+            /* gather the records of other appenders into this commit */
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += log->latency / 1000000;
+            deadline.tv_nsec += log->latency % 1000000 * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            while (log->used < log->batch &&
+                    pthread_cond_timedwait(&log->cond, &log->lock, &deadline) != ETIMEDOUT)
+                ;
+        }
+        polylog_flush(log, 1);
+    }
+    ok = !log->error;
+    if (!ok) {
+        errno = log->error;
+    }
+    pthread_mutex_unlock(&log->lock);
+    return ok;
+}
+
+void
+polylog_index(struct polylog *log, struct polyindex *ix)
+{
+    pthread_mutex_lock(&log->lock);
+    log->index = ix;
+    pthread_mutex_unlock(&log->lock);
+}
+
+int
+polylog_index_copy(struct polylog *log, struct polyindex *dst)
+{
+    const struct polyindex *ix;
+    size_t count;
+    int ok;
+    pthread_mutex_lock(&log->lock);
+    ix = log->index;
+    ok = ix && polyindex_init(dst, ix->stride);
+    if (ok) {
+        count = (ix->records + ix->stride - 1) / ix->stride;
+        dst->offsets = malloc((count ? count : 1) * sizeof(size_t));
+        ok = dst->offsets != NULL;
+    } else if (!ix) {
+        errno = EINVAL;
+    }
+    if (ok) {
+        memcpy(dst->offsets, ix->offsets, count * sizeof(size_t));
+        dst->capacity = count;
+        dst->records = ix->records;
+        dst->size = ix->size;
+    }
+    pthread_mutex_unlock(&log->lock);
+    return ok;
+}
+
+int
+polylog_close(struct polylog *log)
+{
+    int ok;
+    ok = polylog_sync(log, (size_t) -1);
+    pthread_cond_destroy(&log->cond);
+    pthread_mutex_destroy(&log->lock);
+    free(log->buf[0]);
+    free(log->buf[1]);
+    free(log);
+    return ok;
+}
@@ -0,0 +1,129 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _polylog_h_DEFINED
+#define _polylog_h_DEFINED
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "polyfile.h"
+
+/**
+ * polylog - an append-only log of serialized polyads, buffered into large
+ * writes and synced with group commit: a sync waits for (or leads) a
+ * single fdatasync covering every record appended before it.
+ */
+struct polylog;
+
+/**
+ * polylogs are non-const/mutable, and may be shared between threads
+ */
+typedef struct polylog * polylog_t;
+
+/** The alignment of buffered writes, relative to the file offset **/
+#define POLYLOG_ALIGN 4096
+
+/**
+ * Allocate a log appending to a file descriptor.
+ *
+ * Records are buffered in two buffers of {@code bufsize} bytes, one
+ * filling while the other is written out in whole blocks of
+ * {@code POLYLOG_ALIGN} bytes.  A sync gathers the records appended by
+ * other threads into its commit for up to {@code latency} microseconds,
+ * until {@code batch} bytes are buffered.
+ *
+ * @param fd a file descriptor open for writing, at the end of the log,
+ *           which must outlive the log
+ * @param bufsize the size of each buffer, at least {@code POLYLOG_ALIGN}
+ * @param batch the buffered size that starts a commit without waiting
+ * @param latency the most a commit waits for other appenders, in microseconds
+ * @param dst the address of an uninitialized log pointer
+ * @return 1 on success, 0 on error
+ * @error EINVAL {@code bufsize} is less than {@code POLYLOG_ALIGN}
+ * @error ENOMEM memory allocation failure
+ */
+int    polylog_open(int fd, size_t bufsize, size_t batch, unsigned long latency,
+        polylog_t *dst);
+
+/**
+ * Append a record to a log, such as a polyad from {@code polyad_copy}.
+ *
+ * @param log the log
+ * @param data the record
+ * @param len the size of the record
+ * @return the log offset of the end of the record (always > 0), to be
+ *         passed to {@code polylog_sync}, or 0 on error
+ * @error EINVAL {@code len} is 0
+ * @error EIO, ENOSPC, ... a write to the log failed, failing the log
+ */
+size_t polylog_append(polylog_t log, const void *data, size_t len);
+
+/**
+ * Append a record gathered from an I/O vector to a log, such as a polyad
+ * from {@code polyad_iov}.
+ *
+ * @param log the log
+ * @param iov the parts of the record
+ * @param iovcnt the number of parts
+ * @return the log offset of the end of the record, see {@code polylog_append}
+ */
+size_t polylog_appendv(polylog_t log, const struct iovec *iov, int iovcnt);
+
+/**
+ * Wait until a log is durable up to an offset, leading a commit if none
+ * is in progress.
+ *
+ * @param log the log
+ * @param off the log offset to sync, as returned by {@code polylog_append},
+ *            or {@code (size_t) -1} for all records appended so far
+ * @return 1 on success, 0 on error
+ * @error EIO, ENOSPC, ... a write or sync of the log failed, failing the log
+ */
+int    polylog_sync(polylog_t log, size_t off);
+
+/**
+ * Index the records appended to a log from now on (see {@code polyindex_add}),
+ * at their offsets in its file.
+ *
+ * @param log the log
+ * @param ix the index, owned by the caller and read only through
+ *           {@code polylog_index_copy} while the log is in use, or NULL
+ *           to stop indexing
+ */
+void   polylog_index(polylog_t log, struct polyindex *ix);
+
+/**
+ * Copy the index of a log, consistent with the records appended so far.
+ *
+ * @param log the log
+ * @param dst the uninitialized index to copy into, to be freed by the caller
+ * @return 1 on success, 0 on error
+ * @error EINVAL the log is not indexed
+ * @error ENOMEM memory allocation failure
+ */
+int    polylog_index_copy(polylog_t log, struct polyindex *dst);
+
+/**
+ * Sync and free a log, without closing its file descriptor.
+ *
+ * @param log the log, which must not be in use by other threads
+ * @return 1 on success, 0 if the log failed
+ */
+int    polylog_close(polylog_t log);
+
+#endif /* _polylog_h_DEFINED */
@@ -0,0 +1,311 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#include "polyadobject.h"
+#include "polylogobject.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * PyPolylog
+ */
+
+/* Sync and free the log, closing the file if opened by path */
+static int
+_polylog_close(PyPolylog *self)
+{
+    int ok = 1;
+    if (self->log) {
+        Py_BEGIN_ALLOW_THREADS
+        ok = polylog_close(self->log);
+        if (self->fd >= 0 && close(self->fd) && ok) {
+            ok = 0;
+        }
+        Py_END_ALLOW_THREADS
+        self->log = NULL;
+        self->fd = -1;
+    }
+    if (self->indexed) {
+        polyindex_free(&self->index);
+        self->indexed = 0;
+    }
+    return ok;
+}
+
+void
+PyPolylog_dealloc(PyPolylog* self)
+{
+    _polylog_close(self);
+    self->ob_base.ob_type->tp_free((PyObject*)self);
+}
+
+PyObject *
+PyPolylog_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "bufsize", "batch", "latency", "index", NULL};
+    PyObject *src, *path = NULL;
+    Py_ssize_t bufsize = 1 << 20, batch = -1, stride = 0;
+    double latency = 0.0;
+    int fd, ok;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$nndn:polylog", kwlist,
+            &src, &bufsize, &batch, &latency, &stride))
+        return NULL;
+    if (bufsize < POLYLOG_ALIGN || latency < 0 || latency > 60 || stride < 0) {
+        PyErr_SetString(PyExc_ValueError, "bufsize must be at least 4096, "
+                "latency between 0 and 60 seconds, and index not negative");
+        return NULL;
+    }
+
+    PyPolylog *self = (PyPolylog*) type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->fd = -1;
+
+    /* append to a file descriptor, or a file opened by path */
+    if (PyLong_Check(src)) {
+        fd = PyLong_AsLong(src);
+        if (fd == -1 && PyErr_Occurred()) {
+            Py_DECREF(self);
+            return NULL;
+        }
+    } else if (PyUnicode_FSConverter(src, &path)) {
+        Py_BEGIN_ALLOW_THREADS
+        fd = open(PyBytes_AS_STRING(path), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+        Py_END_ALLOW_THREADS
+        Py_DECREF(path);
+        if (fd < 0) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, src);
+            Py_DECREF(self);
+            return NULL;
+        }
+        self->fd = fd;
+    } else {
+        Py_DECREF(self);
+        return NULL;
+    }
+    ok = polylog_open(fd, bufsize, batch < 0 ? bufsize / 2 : batch,
+            latency * 1000000, &self->log);
+    if (!ok) {
+        PyErr_SetFromErrno(errno == ENOMEM ? PyExc_MemoryError : PyExc_OSError);
+        Py_DECREF(self);
+        return NULL;
+    }
+    if (stride) {
+        polyindex_init(&self->index, stride);
+        self->indexed = 1;
+        polylog_index(self->log, &self->index);
+    }
+    return (PyObject*) self;
+}
+
+static int
+_polylog_check(PyPolylog *self)
+{
+    if (!self->log) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed polylog");
+        return 0;
+    }
+    return 1;
+}
+
+static PyObject *
+PyPolylog_append(PyPolylog *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "sync", NULL};
+    PyObject *src, *pack = NULL;
+    Py_buffer view;
+    int sync = 0;
+    size_t off;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$p:append", kwlist, &src, &sync))
+        return NULL;
+    if (!_polylog_check(self))
+        return NULL;
+
+    /* a serialized polyad, or the items of one to pack */
+    if (!PyObject_CheckBuffer(src)) {
+        pack = PyPolyad_FromSequence(src, POLYAD_FORMAT_VARINT,
+                "expected a bufferable or a sequence of items");
+        if (!pack)
+            return NULL;
+        src = pack;
+    }
+    if (PyObject_GetBuffer(src, &view, PyBUF_SIMPLE)) {
+        Py_XDECREF(pack);
+        return NULL;
+    }
+
+    /* appending may wait on the writes of other threads */
+    self->users++;
+    Py_BEGIN_ALLOW_THREADS
+    off = polylog_append(self->log, view.buf, view.len);
+    if (off && sync && !polylog_sync(self->log, off)) {
+        off = 0;
+    }
+    Py_END_ALLOW_THREADS
+    self->users--;
+    PyBuffer_Release(&view);
+    Py_XDECREF(pack);
+
+    if (!off) {
+        PyErr_SetFromErrno(errno == EINVAL ? PyExc_ValueError :
+                errno == ENOMEM ? PyExc_MemoryError : PyExc_OSError);
+        return NULL;
+    }
+    return PyLong_FromSize_t(off);
+}
+
+static PyObject *
+PyPolylog_sync(PyPolylog *self, PyObject *args)
+{
+    Py_ssize_t off = -1;
+    int ok;
+    if (!PyArg_ParseTuple(args, "|n:sync", &off))
+        return NULL;
+    if (!_polylog_check(self))
+        return NULL;
+
+    self->users++;
+    Py_BEGIN_ALLOW_THREADS
+    ok = polylog_sync(self->log, off < 0 ? (size_t) -1 : (size_t) off);
+    Py_END_ALLOW_THREADS
+    self->users--;
+    if (!ok) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyPolylog_index(PyPolylog *self, PyObject *unused)
+{
+    struct polyindex ix;
+    PyObject *res;
+    if (!_polylog_check(self))
+        return NULL;
+    if (!self->indexed) {
+        PyErr_SetString(PyExc_ValueError, "polylog not indexed");
+        return NULL;
+    }
+
+    /* a copy consistent with the records appended by other threads */
+    if (!polylog_index_copy(self->log, &ix)) {
+        PyPolyad_SetErrFromErrno();
+        return NULL;
+    }
+    res = PyBytes_FromStringAndSize(NULL, POLYINDEX_MAX_SIZE(&ix));
+    if (res)
+        _PyBytes_Resize(&res, polyindex_pack(&ix, PyBytes_AS_STRING(res),
+                PyBytes_GET_SIZE(res)));
+    polyindex_free(&ix);
+    return res;
+}
+
+static PyObject *
+PyPolylog_close(PyPolylog *self, PyObject *unused)
+{
+    if (self->users > 0) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot close: polylog in use by other threads");
+        return NULL;
+    }
+    if (!_polylog_close(self)) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyPolylog_enter(PyPolylog *self, PyObject *unused)
+{
+    if (!_polylog_check(self))
+        return NULL;
+    Py_INCREF(self);
+    return (PyObject*) self;
+}
+
+static PyObject *
+PyPolylog_exit(PyPolylog *self, PyObject *args)
+{
+    return PyPolylog_close(self, NULL);
+}
+
+static PyMethodDef PyPolylog_methods[] = {
+    {"append", (PyCFunction)PyPolylog_append, METH_VARARGS | METH_KEYWORDS,
+     "append(record, *, sync=False)\n\n"
+     "Append a polyad (or bufferable, or sequence of items to pack) to the\n"
+     "log, returning the log offset of its end, to pass to sync()."},
+    {"sync", (PyCFunction)PyPolylog_sync, METH_VARARGS,
+     "sync([offset])\n\n"
+     "Wait until the log is durable up to an offset (by default, all records\n"
+     "appended), sharing one fdatasync with concurrent callers."},
+    {"index", (PyCFunction)PyPolylog_index, METH_NOARGS,
+     "The index of the records appended, packed for polyfile(..., index=)"},
+    {"close", (PyCFunction)PyPolylog_close, METH_NOARGS,
+     "Sync and close the log"},
+    {"__enter__", (PyCFunction)PyPolylog_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)PyPolylog_exit, METH_VARARGS, NULL},
+    {NULL}  /* Sentinel */
+};
+
+/* PyPolylog type definition */
+PyTypeObject PyPolylog_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "polyadicts.polylog",       /*tp_name*/
+    sizeof(PyPolylog),          /*tp_basicsize*/
+    0,                          /*tp_itemsize*/
+    (destructor)PyPolylog_dealloc, /*tp_dealloc*/
+    0,                          /*tp_print*/
+    0,                          /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    0,                          /*tp_repr*/
+    0,                          /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    0,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    "polylog(path | fd, *, bufsize=1048576, batch=bufsize // 2, latency=0.0, index=0)\n\n"
+    "An append-only log of polyads, buffered into large writes and synced\n"
+    "with group commit: concurrent syncs share one fdatasync, for which a\n"
+    "sync waits up to latency seconds until batch bytes are appended.\n"
+    "With index, every index-th record appended is indexed, see index().", /* tp_doc */
+    0,                          /* tp_traverse */
+    0,                          /* tp_clear */
+    0,                          /* tp_richcompare */
+    0,                          /* tp_weaklistoffset */
+    0,                          /* tp_iter */
+    0,                          /* tp_iternext */
+    PyPolylog_methods,          /* tp_methods */
+    0,                          /* tp_members */
+    0,                          /* tp_getset */
+    0,                          /* tp_base */
+    0,                          /* tp_dict */
+    0,                          /* tp_descr_get */
+    0,                          /* tp_descr_set */
+    0,                          /* tp_dictoffset */
+    0,                          /* tp_init */
+    0,                          /* tp_alloc */
+    PyPolylog_tp_new,           /* tp_new */
+};
@@ -0,0 +1,46 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+#ifndef _polylogobject_h_DEFINED
+#define _polylogobject_h_DEFINED
+
+#include <Python.h>
+#include "polylog.h"
+
+typedef struct PyPolylog_st
+{
+    PyObject_HEAD
+    /* underlying C log, NULL once closed */
+    polylog_t log;
+    /* the file descriptor, if opened by path */
+    int fd;
+    /* the number of calls in progress without the GIL */
+    Py_ssize_t users;
+    /* the index of the records appended, if any */
+    struct polyindex index;
+    int indexed;
+} PyPolylog;
+
+PyAPI_FUNC(void) PyPolylog_dealloc(PyPolylog* self);
+PyAPI_FUNC(PyObject *) PyPolylog_tp_new(PyTypeObject *type, PyObject *args,
+        PyObject *kwds);
+
+/* PyPolylog type definition */
+PyAPI_DATA(PyTypeObject) PyPolylog_Type;
+
+#endif
@@ -19,62 +19,15 @@
 
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include "varint.h"
+#include "polyadicts_inline.h"
 
-static const uint8_t LogTable256[256] =
-{
-#define LT(n) \
-    n, n, n, n, n, n, n, n, n, n, n, n, n, n, n, n
-    0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
-    LT(4), LT(5), LT(5), LT(6), LT(6), LT(6), LT(6),
-    LT(7), LT(7), LT(7), LT(7), LT(7), LT(7), LT(7), LT(7)
-};
-#define uint8_log2(x) LogTable256[(x) & 0xff]
-
-static inline uint8_t
-uint32_log2(const uint32_t x)
-{
-#if defined(__i386__) || defined(__x86_64__)
-    /*
-     * Use Intel "bsr" operation for highest bit set
-     */
-    uint32_t y;
-    /* bsr output operand undefined when input is zero */
-    if (!x) return 0;
-    __asm__ (
-        "\tbsr %1, %0\n"
-        : "=r"(y)
-        : "r" (x)
-        );
-    return y;
-#else
-    /*
-     * Use binary search tree with lookup table.
-     */
-    if (x < 0x10000) {
-        if (x < 0x100) {
-            return uint8_log2(x);
-        } else {
-            return uint8_log2(x >> 8) + 8;
-        }
-    } else {
-        if (x < 0x1000000) {
-            return uint8_log2(x >> 16) + 16;
-        } else {
-            return uint8_log2(x >> 24) + 24;
-        }
-    }
+#if defined(__x86_64__) && defined(__GNUC__) && defined(VI_LE64)
+#include <immintrin.h>
+#define VI_X86 1
 #endif
-}
-
-static inline uint8_t
-uint64_log2(const uint64_t x)
-{
-    if (x < 0x100000000LL)
-        return uint32_log2(x);
-    return uint32_log2(x >> 32) + 32;
-}
 
 static inline uint8_t
 vi_rv(const void *vi, uint8_t i)
@@ -82,12 +35,6 @@ vi_rv(const void *vi, uint8_t i)
     return ((uint8_t *)vi)[i];
 }
 
-static inline uint8_t *
-vi_lvp(void *vi, uint8_t i)
-{
-    return &(((uint8_t *)vi)[i]);
-}
-
 size_t
 vi_copy(const void *const src, size_t len, void *const dst)
 {
@@ -110,45 +57,304 @@ vi_copy(const void *const src, size_t len, void *const dst)
 }
 
 size_t
-vi_to_size(const void *const src, size_t len, size_t *dst)
+vi_span(const void *const src, size_t len, size_t n)
 {
-    size_t x, i;
-    x = i = 0;
-    for (;;) {
-        if (i == len) {
-            errno = EINVAL;
+    const uint8_t *const v = src;
+    size_t off, c;
+    uint64_t ends;
+    off = 0;
+    if (!n)
+        return 0;
+#ifdef VI_LE64
+    /* count the terminators of eight bytes at a time */
+    for (; len - off >= sizeof(ends); off += sizeof(ends)) {
+        ends = ~_vi_load64(v + off) & 0x8080808080808080ULL;
+        c = __builtin_popcountll(ends);
+        if (c >= n) {
+            while (--n) {
+                ends &= ends - 1;
+            }
+            return off + __builtin_ctzll(ends) / 8 + 1;
+        }
+        n -= c;
+    }
+#endif
+    for (; off < len; off++) {
+        if (!(v[off] & 0x80) && !--n) {
+            return off + 1;
+        }
+    }
+    errno = EINVAL;
+    return 0;
+}
+
+static size_t
+vi_to_size_scalar(const void *const src, size_t len, size_t *dst)
+{
+    return vi_to_size_inline(src, len, dst);
+}
+
+static size_t
+vi_to_sizes_scalar(const void *const src, size_t len, size_t n, size_t *dst)
+{
+    size_t off, i, m;
+    off = 0;
+    for (i = 0; i < n; i++) {
+        m = vi_to_size_scalar((const uint8_t *)src + off, len - off, &dst[i]);
+        if (!m)
             return 0;
-        } else if (i == VI_MAX_LEN) {
+        off += m;
+    }
+    return off;
+}
+
+static size_t
+size_to_vi_scalar(size_t x, void *const v, size_t l)
+{
+    return size_to_vi_inline(x, v, l);
+}
+
+static size_t
+sizes_vi_len_scalar(size_t n, const size_t *const src)
+{
+    size_t s, any, i;
+    s = any = 0;
+    for (i = 0; i < n; i++) {
+        any |= src[i];
+        s += _vi_len(src[i]);
+    }
+    /* VI_MAX is all ones: any value exceeding it sets a higher bit */
+    if (any > VI_MAX) {
+        errno = ERANGE;
+        return 0;
+    }
+    return s;
+}
+
+static size_t
+sizes_to_vi_scalar(size_t n, const size_t *const src, void *const dst, size_t len)
+{
+    uint8_t *const v = dst;
+    size_t off, i, m;
+    uint64_t x;
+    off = i = 0;
+#ifdef VI_LE64
+    /* write each varint with one unaligned store while 9 bytes remain */
+    for (; i < n && len - off >= VI_MAX_LEN; i++) {
+        if (src[i] > VI_MAX) {
             errno = ERANGE;
             return 0;
+        }
+        m = _vi_len(src[i]);
+        if (m < VI_MAX_LEN) {
+            x = _vi_scatter(src[i]) | (0x0080808080808080ULL >> (64 - 8 * m));
         } else {
-            x |= (vi_rv(src, i) & 0x7fLL) << (7 * i);
-            if (!(vi_rv(src, i++) & 0x80)) {
-                *dst = x;
-                return i;
-            }
+            x = _vi_scatter(src[i]) | 0x8080808080808080ULL;
+            v[off + 8] = src[i] >> 56;
         }
+        memcpy(v + off, &x, sizeof(x));
+        off += m;
+    }
+#endif
+    for (; i < n; i++) {
+        m = size_to_vi_scalar(src[i], v + off, len - off);
+        if (!m)
+            return 0;
+        off += m;
     }
+    return off;
 }
 
-size_t
-size_to_vi(size_t x, void *const v, size_t l)
+#ifdef VI_X86
+/*
+ * Masked-VByte style shuffle table for 8 bytes of a window, indexed by
+ * their terminator mask.  Each entry moves up to 8 leading one- or
+ * two-byte varints into 16-bit lanes; {@code count} is zero when the
+ * leading varint is longer than two bytes or unterminated.
+ */
+static struct vi_shuffle {
+    uint8_t count;
+    uint8_t bytes;
+    uint8_t shuf[16];
+} vi_shuffle[256];
+
+static void
+vi_shuffle_init(void)
 {
-    size_t s, i;
-    if (x > VI_MAX) {
-        errno = ERANGE;
-        return 0;
+    unsigned mask, start, end, j;
+    for (mask = 0; mask < 256; mask++) {
+        struct vi_shuffle *const e = &vi_shuffle[mask];
+        memset(e->shuf, 0x80, sizeof(e->shuf));
+        start = j = 0;
+        for (end = 0; end < 8; end++) {
+            if (!(mask & (1 << end)))
+                continue;
+            if (end - start > 1)
+                break;
+            e->shuf[2 * j] = start;
+            if (end > start)
+                e->shuf[2 * j + 1] = end;
+            start = end + 1;
+            j++;
+        }
+        e->count = j;
+        e->bytes = start;
     }
-    s = uint64_log2(x) / 7 + 1;
-    if (s > l) {
-        errno = EINVAL;
-        return 0;
+}
+
+/* Zero-extend sixteen single-byte varints into sizes. */
+static inline void
+vi_widen16(__m128i v, size_t *dst)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i w[2] = { _mm_unpacklo_epi8(v, z), _mm_unpackhi_epi8(v, z) };
+    int j;
+    for (j = 0; j < 2; j++) {
+        const __m128i lo = _mm_unpacklo_epi16(w[j], z);
+        const __m128i hi = _mm_unpackhi_epi16(w[j], z);
+        _mm_storeu_si128((__m128i *)dst + 0, _mm_unpacklo_epi32(lo, z));
+        _mm_storeu_si128((__m128i *)dst + 1, _mm_unpackhi_epi32(lo, z));
+        _mm_storeu_si128((__m128i *)dst + 2, _mm_unpacklo_epi32(hi, z));
+        _mm_storeu_si128((__m128i *)dst + 3, _mm_unpackhi_epi32(hi, z));
+        dst += 8;
     }
-    if (v) {
-        for (i = 0; i < s - 1; i++, x >>= 7) {
-            *vi_lvp(v,i) = (x & 0x7f) | 0x80;
+}
+
+#define VI_TIER ssse3
+#define VI_TARGET "ssse3"
+#define VI_WINDOW 16
+#include "vikernel.h"
+
+#define VI_TIER bmi2
+#define VI_TARGET "ssse3,popcnt,bmi,bmi2,lzcnt"
+#define VI_WINDOW 16
+#define VI_PEXT 1
+#include "vikernel.h"
+
+#define VI_TIER avx2
+#define VI_TARGET "avx2,popcnt,bmi,bmi2,lzcnt"
+#define VI_WINDOW 32
+#define VI_PEXT 1
+#include "vikernel.h"
+
+#define VI_TIER avx512
+#define VI_TARGET "avx512f,avx512bw,avx512cd,avx2,popcnt,bmi,bmi2,lzcnt"
+#define VI_WINDOW 64
+#define VI_PEXT 1
+#define VI_LZCNT512 1
+#include "vikernel.h"
+#endif
+
+/*
+ * Kernel dispatch table, one entry per tier in order of preference.
+ */
+struct vi_kernels {
+    const char *name;
+    size_t (*to_size)(const void *, size_t, size_t *);
+    size_t (*to_sizes)(const void *, size_t, size_t, size_t *);
+    size_t (*from_size)(size_t, void *, size_t);
+    size_t (*sizes_len)(size_t, const size_t *);
+    size_t (*from_sizes)(size_t, const size_t *, void *, size_t);
+};
+
+#define VI_KERNELS(tier) { #tier, \
+    vi_to_size_##tier, vi_to_sizes_##tier, size_to_vi_##tier, \
+    sizes_vi_len_##tier, sizes_to_vi_##tier }
+
+static const struct vi_kernels vi_tiers[] = {
+    VI_KERNELS(scalar),
+#ifdef VI_X86
+    VI_KERNELS(ssse3),
+    VI_KERNELS(bmi2),
+    VI_KERNELS(avx2),
+    VI_KERNELS(avx512),
+#endif
+};
+
+static const struct vi_kernels *vi_kernel = &vi_tiers[0];
+
+/* The index of the best tier supported by the running CPU */
+static size_t
+vi_supported(void)
+{
+#ifdef VI_X86
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("ssse3"))
+        return 0;
+    /* pext and pdep are microcoded (slow) on AMD before Zen 3 */
+    if (!__builtin_cpu_supports("bmi2") ||
+            __builtin_cpu_is("znver1") || __builtin_cpu_is("znver2"))
+        return 1;
+    if (!__builtin_cpu_supports("avx2"))
+        return 2;
+    if (!__builtin_cpu_supports("avx512bw") ||
+            !__builtin_cpu_supports("avx512cd"))
+        return 3;
+    return 4;
+#else
+    return 0;
+#endif
+}
+
+const char *
+vi_init(const char *tier)
+{
+    size_t best, i;
+    best = vi_supported();
+    if (tier) {
+        for (i = 0; i < best; i++) {
+            if (!strcmp(tier, vi_tiers[i].name)) {
+                best = i;
+                break;
+            }
         }
-        *vi_lvp(v,i) = (x & 0x7f);
     }
-    return s;
+    vi_kernel = &vi_tiers[best];
+    return vi_kernel->name;
+}
+
+const char *
+vi_tier(void)
+{
+    return vi_kernel->name;
+}
+
+__attribute__((constructor))
+static void
+vi_setup(void)
+{
+#ifdef VI_X86
+    vi_shuffle_init();
+#endif
+    vi_init(getenv("POLYADICTS_VI_TIER"));
+}
+
+size_t
+vi_to_size(const void *const src, size_t len, size_t *dst)
+{
+    return vi_kernel->to_size(src, len, dst);
+}
+
+size_t
+vi_to_sizes(const void *const src, size_t len, size_t n, size_t *dst)
+{
+    return vi_kernel->to_sizes(src, len, n, dst);
+}
+
+size_t
+size_to_vi(size_t x, void *const v, size_t l)
+{
+    return vi_kernel->from_size(x, v, l);
+}
+
+size_t
+sizes_vi_len(size_t n, const size_t *const src)
+{
+    return vi_kernel->sizes_len(n, src);
+}
+
+size_t
+sizes_to_vi(size_t n, const size_t *const src, void *const dst, size_t len)
+{
+    return vi_kernel->from_sizes(n, src, dst, len);
 }
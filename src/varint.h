@@ -26,6 +26,8 @@
 #define VI_MAX_LEN (sizeof(size_t) * 8 / 7)
 /** This provides for 63 bits of data **/
 #define VI_MAX ((1ULL << (7 * VI_MAX_LEN)) - 1LL)
+/** The worst-case length of {@code n} varints **/
+#define VI_MAX_SIZE(n) ((n) * VI_MAX_LEN)
 
 /**
  * Copy a 7-bit varint from one buffer to another.
@@ -51,6 +53,33 @@ size_t vi_copy(const void *src, size_t len, void *dst);
  */
 size_t vi_to_size(const void *src, size_t len, size_t *dst);
 
+/**
+ * Read consecutive 7-bit varints from a buffer into an array of sizes.
+ *
+ * @param src the source buffer (contains {@code n} varints)
+ * @param len the length of the source buffer
+ * @param n the number of varints to read
+ * @param dst an array of size {@code n} to store the sizes
+ * @return the number of bytes read from {@code src}
+ * @error EINVAL if {@code len} is too short to read all {@code n} varints
+ * @error ERANGE if any varint is longer than {@code VI_MAX_LEN}
+ */
+size_t vi_to_sizes(const void *src, size_t len, size_t n, size_t *dst);
+
+/**
+ * Find the length of consecutive 7-bit varints without decoding them.
+ *
+ * Only terminating bytes are counted: varints longer than
+ * {@code VI_MAX_LEN} are not detected until they are read.
+ *
+ * @param src the source buffer (containing varints)
+ * @param len the length of the source buffer
+ * @param n the number of varints to skip
+ * @return the number of bytes spanned by {@code n} varints
+ * @error EINVAL if {@code len} is too short to contain {@code n} varints
+ */
+size_t vi_span(const void *src, size_t len, size_t n);
+
 /**
  * Write a standard unsigned size type to a buffer as a 7-bit varint.
  *
@@ -63,4 +92,46 @@ size_t vi_to_size(const void *src, size_t len, size_t *dst);
  */
 size_t size_to_vi(size_t src, void *dst, size_t len);
 
+/**
+ * Compute the total length of an array of sizes written as 7-bit varints.
+ *
+ * @param n the number of sizes
+ * @param src the array of sizes
+ * @return the number of bytes needed to write all of {@code src}
+ * @error ERANGE if any size would be longer than {@code VI_MAX_LEN}
+ */
+size_t sizes_vi_len(size_t n, const size_t *src);
+
+/**
+ * Write an array of sizes to a buffer as consecutive 7-bit varints.
+ *
+ * Given a destination of at least {@code VI_MAX_SIZE(n)} bytes, each
+ * varint is written without bounds checks and the exact length returned.
+ *
+ * @param n the number of sizes
+ * @param src the array of sizes
+ * @param dst the destination buffer (to contain {@code n} varints)
+ * @param len the length of the destination buffer
+ * @return the number of bytes written to {@code dst}
+ * @error EINVAL if {@code len} is too short to write all of {@code src}
+ * @error ERANGE if any size would be longer than {@code VI_MAX_LEN}
+ */
+size_t sizes_to_vi(size_t n, const size_t *src, void *dst, size_t len);
+
+/**
+ * Select the varint kernels for the running CPU.
+ *
+ * Kernels are selected once when the library is loaded, honouring a tier
+ * named by the {@code POLYADICTS_VI_TIER} environment variable.
+ *
+ * @param tier the preferred tier ("scalar", "ssse3", "bmi2", "avx2" or
+ *   "avx512"), or NULL for the best tier supported
+ * @return the name of the selected tier: {@code tier} if supported,
+ *   otherwise the best supported tier
+ */
+const char * vi_init(const char *tier);
+
+/** The name of the selected varint kernel tier. **/
+const char * vi_tier(void);
+
 #endif /* _varint_h_DEFINED */
@@ -0,0 +1,312 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Varint kernels for a single CPU tier, included once per tier by
+ * varint.c with the following defined:
+ *
+ *   VI_TIER      the suffix naming each kernel of the tier
+ *   VI_TARGET    the compiler target features of the tier
+ *   VI_WINDOW    the decode window width in bytes (16, 32 or 64)
+ *   VI_PEXT      (optional) gather and scatter with BMI2 pext/pdep
+ *   VI_LZCNT512  (optional) compute lengths with AVX-512 vplzcntq
+ *
+ * All of the above are undefined again at the end of this file.
+ */
+
+#define VI_CAT_(name, tier) name ## _ ## tier
+#define VI_CAT(name, tier) VI_CAT_(name, tier)
+#define VI_FN(name) VI_CAT(name, VI_TIER)
+#define VI_ATTR __attribute__((target(VI_TARGET)))
+
+#if VI_WINDOW == 64
+#define VI_ALL (~0ULL)
+#else
+#define VI_ALL ((1ULL << VI_WINDOW) - 1)
+#endif
+
+VI_ATTR static inline uint64_t
+VI_FN(vi_gather)(uint64_t x, unsigned n)
+{
+#ifdef VI_PEXT
+    return _pext_u64(x, 0x7f7f7f7f7f7f7f7fULL >> (64 - 8 * n));
+#else
+    return _vi_gather(x, n);
+#endif
+}
+
+VI_ATTR static inline uint64_t
+VI_FN(vi_scatter)(uint64_t x)
+{
+#ifdef VI_PEXT
+    return _pdep_u64(x, 0x7f7f7f7f7f7f7f7fULL);
+#else
+    return _vi_scatter(x);
+#endif
+}
+
+/* The terminator (clear sign bit) mask of a window */
+VI_ATTR static inline uint64_t
+VI_FN(vi_ends)(const uint8_t *src)
+{
+#if VI_WINDOW == 64
+    return ~_mm512_movepi8_mask(_mm512_loadu_si512(src));
+#elif VI_WINDOW == 32
+    return (uint32_t) ~_mm256_movemask_epi8(
+            _mm256_loadu_si256((const __m256i *)src));
+#else
+    return ~_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)src)) & 0xffff;
+#endif
+}
+
+/* Zero-extend a window of single-byte varints into sizes. */
+VI_ATTR static inline void
+VI_FN(vi_widen)(const uint8_t *src, size_t *dst)
+{
+    int j;
+#if VI_WINDOW == 64
+    for (j = 0; j < VI_WINDOW; j += 8) {
+        _mm512_storeu_si512(dst + j, _mm512_cvtepu8_epi64(
+                    _mm_loadl_epi64((const __m128i *)(src + j))));
+    }
+#elif VI_WINDOW == 32
+    uint32_t x;
+    for (j = 0; j < VI_WINDOW; j += 4) {
+        memcpy(&x, src + j, sizeof(x));
+        _mm256_storeu_si256((__m256i *)(dst + j),
+                _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(x)));
+    }
+#else
+    (void) j;
+    vi_widen16(_mm_loadu_si128((const __m128i *)src), dst);
+#endif
+}
+
+/*
+ * Decode the short varints at {@code src} through the shuffle table,
+ * storing 8 sizes of which the first {@code e->count} are valid.
+ */
+VI_ATTR static inline void
+VI_FN(vi_shuffle8)(const uint8_t *src, const struct vi_shuffle *e, size_t *dst)
+{
+    const __m128i z = _mm_setzero_si128();
+    __m128i v, lo, hi;
+    v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src),
+            _mm_loadu_si128((const __m128i *)e->shuf));
+    v = _mm_or_si128(
+            _mm_and_si128(v, _mm_set1_epi16(0x007f)),
+            _mm_srli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x7f00)), 1));
+    lo = _mm_unpacklo_epi16(v, z);
+    hi = _mm_unpackhi_epi16(v, z);
+    _mm_storeu_si128((__m128i *)dst + 0, _mm_unpacklo_epi32(lo, z));
+    _mm_storeu_si128((__m128i *)dst + 1, _mm_unpackhi_epi32(lo, z));
+    _mm_storeu_si128((__m128i *)dst + 2, _mm_unpacklo_epi32(hi, z));
+    _mm_storeu_si128((__m128i *)dst + 3, _mm_unpackhi_epi32(hi, z));
+}
+
+/*
+ * Decode a single varint, from one unaligned load and a count of
+ * trailing zeros when more than VI_MAX_LEN bytes are readable.
+ */
+VI_ATTR static size_t
+VI_FN(vi_to_size)(const void *const src_, size_t len, size_t *dst)
+{
+    const uint8_t *const src = src_;
+    uint64_t x, ends;
+    size_t n;
+    if (len > VI_MAX_LEN) {
+        x = _vi_load64(src);
+        ends = ~x & 0x8080808080808080ULL;
+        if (ends) {
+            n = __builtin_ctzll(ends) / 8 + 1;
+            *dst = VI_FN(vi_gather)(x, n);
+            return n;
+        } else if (!(src[8] & 0x80)) {
+            *dst = VI_FN(vi_gather)(x, 8) | ((uint64_t)src[8] << 56);
+            return VI_MAX_LEN;
+        } else {
+            errno = ERANGE;
+            return 0;
+        }
+    }
+    return _vi_to_size_checked(src, len, dst);
+}
+
+/*
+ * Decode varints a window at a time.  The terminator mask of the window
+ * marks the last byte of every varint ending within it: a window of
+ * single-byte varints is widened directly, runs of one- and two-byte
+ * varints go through the shuffle table, and longer varints are located
+ * with a count of trailing zeros and extracted from a single unaligned
+ * load, without testing individual bytes.  The buffer tail and any
+ * malformed varint are left to the checked scalar loop.
+ */
+VI_ATTR static size_t
+VI_FN(vi_to_sizes)(const void *const src_, size_t len, size_t n, size_t *dst)
+{
+    const uint8_t *const src = src_;
+    size_t off, i, m;
+    uint64_t ends, x;
+    unsigned start, end;
+    off = i = 0;
+    while (i < n && len - off >= VI_WINDOW + 8) {
+        ends = VI_FN(vi_ends)(src + off);
+        if (ends == VI_ALL && n - i >= VI_WINDOW) {
+            VI_FN(vi_widen)(src + off, &dst[i]);
+            i += VI_WINDOW;
+            off += VI_WINDOW;
+            continue;
+        }
+        start = 0;
+        while (start + 8 <= VI_WINDOW && n - i >= 8) {
+            const struct vi_shuffle *const e = &vi_shuffle[(ends >> start) & 0xff];
+            if (!e->count)
+                break;
+            VI_FN(vi_shuffle8)(src + off + start, e, &dst[i]);
+            i += e->count;
+            start += e->bytes;
+        }
+        ends = start < VI_WINDOW ? ends & (~0ULL << start) : 0;
+        while (ends && i < n) {
+            end = __builtin_ctzll(ends) + 1;
+            if (end - start > VI_MAX_LEN)
+                break;
+            if (end - start > 8) {
+                x = VI_FN(vi_gather)(_vi_load64(src + off + start), 8) |
+                    ((uint64_t)(src[off + start + 8] & 0x7f) << 56);
+            } else {
+                x = VI_FN(vi_gather)(_vi_load64(src + off + start), end - start);
+            }
+            dst[i++] = x;
+            start = end;
+            ends &= ends - 1;
+        }
+        if (!start)
+            break;
+        off += start;
+    }
+    for (; i < n; i++) {
+        m = VI_FN(vi_to_size)(src + off, len - off, &dst[i]);
+        if (!m)
+            return 0;
+        off += m;
+    }
+    return off;
+}
+
+VI_ATTR static size_t
+VI_FN(size_to_vi)(size_t x, void *const dst, size_t len)
+{
+    uint8_t *const v = dst;
+    size_t s, i;
+    uint64_t y;
+    if (x > VI_MAX) {
+        errno = ERANGE;
+        return 0;
+    }
+    s = _vi_len(x);
+    if (s > len) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (v) {
+        y = VI_FN(vi_scatter)(x) | 0x8080808080808080ULL;
+        for (i = 0; i < s - 1 && i < 8; i++, y >>= 8) {
+            v[i] = y;
+        }
+        v[i] = i < 8 ? y & 0x7f : x >> 56;
+    }
+    return s;
+}
+
+VI_ATTR static size_t
+VI_FN(sizes_vi_len)(size_t n, const size_t *const src)
+{
+    size_t s, any, i;
+    s = any = i = 0;
+#ifdef VI_LZCNT512
+    /* length = (64 - lzcnt(x | 1) + 6) / 7, dividing by 7 as * 37 >> 8 */
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i c70 = _mm512_set1_epi64(70);
+    const __m512i c37 = _mm512_set1_epi64(37);
+    __m512i vs, va, v;
+    vs = va = _mm512_setzero_si512();
+    for (; i + 8 <= n; i += 8) {
+        v = _mm512_loadu_si512(src + i);
+        va = _mm512_or_si512(va, v);
+        v = _mm512_lzcnt_epi64(_mm512_or_si512(v, one));
+        v = _mm512_mullo_epi32(_mm512_sub_epi64(c70, v), c37);
+        vs = _mm512_add_epi64(vs, _mm512_srli_epi64(v, 8));
+    }
+    s = _mm512_reduce_add_epi64(vs);
+    any = _mm512_reduce_or_epi64(va);
+#endif
+    for (; i < n; i++) {
+        any |= src[i];
+        s += _vi_len(src[i]);
+    }
+    if (any > VI_MAX) {
+        errno = ERANGE;
+        return 0;
+    }
+    return s;
+}
+
+VI_ATTR static size_t
+VI_FN(sizes_to_vi)(size_t n, const size_t *const src, void *const dst, size_t len)
+{
+    uint8_t *const v = dst;
+    size_t off, i, m;
+    uint64_t x;
+    off = 0;
+    for (i = 0; i < n && len - off >= VI_MAX_LEN; i++) {
+        if (src[i] > VI_MAX) {
+            errno = ERANGE;
+            return 0;
+        }
+        m = _vi_len(src[i]);
+        if (m < VI_MAX_LEN) {
+            x = VI_FN(vi_scatter)(src[i]) |
+                (0x0080808080808080ULL >> (64 - 8 * m));
+        } else {
+            x = VI_FN(vi_scatter)(src[i]) | 0x8080808080808080ULL;
+            v[off + 8] = src[i] >> 56;
+        }
+        memcpy(v + off, &x, sizeof(x));
+        off += m;
+    }
+    for (; i < n; i++) {
+        m = size_to_vi_scalar(src[i], v + off, len - off);
+        if (!m)
+            return 0;
+        off += m;
+    }
+    return off;
+}
+
+#undef VI_ALL
+#undef VI_ATTR
+#undef VI_FN
+#undef VI_CAT
+#undef VI_CAT_
+#undef VI_LZCNT512
+#undef VI_PEXT
+#undef VI_WINDOW
+#undef VI_TARGET
+#undef VI_TIER
@@ -0,0 +1,64 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+
+#include "zigzag.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void
+zig64_array(size_t n, const int64_t *src, uint64_t *dst)
+{
+    size_t i;
+    i = 0;
+#if defined(__SSE2__)
+    /* SSE2 has no 64-bit arithmetic shift: broadcast the high dword sign */
+    for (; i + 2 <= n; i += 2) {
+        const __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i s = _mm_shuffle_epi32(_mm_srai_epi32(x, 31),
+                _MM_SHUFFLE(3, 3, 1, 1));
+        _mm_storeu_si128((__m128i *)(dst + i),
+                _mm_xor_si128(_mm_slli_epi64(x, 1), s));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = zig64(src[i]);
+    }
+}
+
+void
+zag64_array(size_t n, const uint64_t *src, int64_t *dst)
+{
+    size_t i;
+    i = 0;
+#if defined(__SSE2__)
+    const __m128i one = _mm_set1_epi64x(1);
+    for (; i + 2 <= n; i += 2) {
+        const __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i s = _mm_sub_epi64(_mm_setzero_si128(),
+                _mm_and_si128(x, one));
+        _mm_storeu_si128((__m128i *)(dst + i),
+                _mm_xor_si128(_mm_srli_epi64(x, 1), s));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = zag64(src[i]);
+    }
+}
@@ -0,0 +1,62 @@
+
+/*
+** This file is part of polyadicts - addicted to data encapsulation.
+**
+** Polyadicts is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** Polyadicts is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** and the GNU Lesser Public License along with polyadicts.  If not, see
+** <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _zigzag_h_DEFINED
+#define _zigzag_h_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * zigzag - map signed integers to unsigned, small magnitudes to small values
+ */
+
+/** ZigZag encode a signed integer as unsigned. **/
+static inline uint64_t
+zig64(int64_t n)
+{
+    return ((uint64_t) n << 1) ^ (uint64_t) (n >> 63);
+}
+
+/** ZigZag decode an unsigned integer as signed. **/
+static inline int64_t
+zag64(uint64_t n)
+{
+    return (int64_t) (n >> 1) ^ -(int64_t) (n & 1);
+}
+
+/**
+ * ZigZag encode an array of signed integers.
+ *
+ * @param n the number of integers
+ * @param src the signed source array
+ * @param dst the unsigned destination array (may be {@code src})
+ */
+void zig64_array(size_t n, const int64_t *src, uint64_t *dst);
+
+/**
+ * ZigZag decode an array of unsigned integers.
+ *
+ * @param n the number of integers
+ * @param src the unsigned source array
+ * @param dst the signed destination array (may be {@code src})
+ */
+void zag64_array(size_t n, const uint64_t *src, int64_t *dst);
+
+#endif /* _zigzag_h_DEFINED */
@@ -28,15 +28,39 @@ def main(buildroot='build'):
     test_ntuple_range()
     test_ntuple_erange()
     test_ntuple_einval()
+    test_ntuple_bulk()
+    test_vi_tiers()
+    test_ntuple_typed()
 
     test_polyad_from_bytes()
     test_polyad_from_sequence()
     test_polyad_from_other()
     test_polyad_einval()
+    test_polyad_group()
+    test_polyad_lazy()
+    test_polyad_indexed()
+    test_polyad_iterable()
+    test_polyad_get()
+    test_polyad_unpack()
+    test_polyad_freelist()
+    test_polyad_verify()
+    test_polyfile()
+    test_polyfile_index()
+    test_polyad_item_refs()
+    test_load_many()
+    test_polyad_writev()
     test_polyad_enomem()
+    # after test_polyad_enomem, which the arenas of threads would defeat
+    test_polylog()
+    test_polyfile_scan()
+    test_nogil()
+    test_polyfile_nogil()
 
     test_zig()
     test_zag()
+    test_zigzag_typed()
+    test_ntuple_delta()
+    test_ntuple_bitpack()
     test_varyad()
     test_varyad_default()
     test_varyad_to_polyad()
@@ -104,6 +128,10 @@ def test_ntuple_range():
 
 def test_ntuple_erange():
     assert_raises(OverflowError, pd.ntuple, [1 << 64])
+    assert_raises(OverflowError, pd.ntuple, [1 << 63])
+    assert_raises(OverflowError, pd.ntuple, [0] * 20 + [1 << 63])
+    assert_raises(OverflowError, pd.ntuple, b'\xff' * 16)
+    assert_raises(OverflowError, pd.polyad, b'\xff' * 16)
     assert_raises(OverflowError, pd.ntuple, b'\x01' + 9 * b'\xff' + b'\x01')
 
     b = b'\x01' + 8 * b'\x80' + b'\x01'
@@ -118,10 +146,65 @@ def test_ntuple_erange():
     t = pd.ntuple([t[0]])
     assert(b == bytes(t))
 
+    p = pd.polyad(b'\x81\x80\x80\x80\x80\x80\x80\x80\x00' + b'\x00' * 8)
+    assert(1 == len(p))
+
 def test_ntuple_einval():
     assert_raises(ValueError, pd.ntuple, b'\x01')
     assert_raises(ValueError, pd.ntuple, b'\x01\xff')
 
+def test_ntuple_bulk():
+    import random
+    r = random.Random(1)
+    for bits in (7, 14, 21, 35, 63):
+        t = tuple(r.getrandbits(r.randint(1, bits)) for i in range(1000))
+        b = pd.ntuple(t)
+        assert(t == pd.ntuple(b))
+        assert_raises(ValueError, pd.ntuple, b[:-1])
+    b = pd.ntuple([0] * 40)
+    assert(b'\x28' + b'\x00' * 40 == b)
+    assert((0,) * 40 == pd.ntuple(b))
+    b = b'\x28' + b'\x00' * 20 + b'\xff' * 10 + b'\x00' * 20
+    assert_raises(OverflowError, pd.ntuple, b)
+
+def test_ntuple_typed():
+    from array import array
+    t = (0, 1, 127, 128, 1 << 40, (1 << 63) - 1)
+    b = pd.ntuple(t)
+    a = pd.ntuple(b, array=True)
+    assert('Q' == a.typecode)
+    assert(t == tuple(a))
+    assert(b == pd.ntuple(a))
+    assert(b == pd.ntuple(memoryview(a)))
+    out = array('Q', [7] * 8)
+    assert(6 == pd.ntuple(b, out=out))
+    assert(t + (7, 7) == tuple(out))
+    out = bytearray(48)
+    assert(6 == pd.ntuple(b, out=out))
+    assert(t == tuple(memoryview(out).cast('Q')))
+    assert_raises(ValueError, pd.ntuple, b, out=bytearray(40))
+    assert_raises(BufferError, pd.ntuple, b, out=bytes(48))
+    assert_raises(TypeError, pd.ntuple, a, array=True)
+    assert_raises(TypeError, pd.ntuple, [1, 2], array=True)
+    assert_raises(TypeError, pd.ntuple, b, foo=True)
+    assert(b'\x00' == pd.ntuple(array('Q')))
+    assert(b'\x02\x01\x02' == pd.ntuple(array('q', [1, 2])))
+    assert_raises(OverflowError, pd.ntuple, array('q', [1, -1]))
+
+def test_vi_tiers():
+    import os, subprocess
+    tiers = ('scalar', 'ssse3', 'bmi2', 'avx2', 'avx512')
+    assert(pd.vi_tier in tiers)
+    code = ('import polyadicts as pd, random; r = random.Random(3); '
+            't = tuple(r.getrandbits(r.randint(1, 63)) for i in range(999)); '
+            'assert(t == pd.ntuple(pd.ntuple(t))); print(pd.vi_tier)')
+    for tier in tiers:
+        env = dict(os.environ, POLYADICTS_VI_TIER=tier,
+                PYTHONPATH=os.path.dirname(pd.__file__))
+        out = subprocess.check_output([sys.executable, '-c', code], env=env)
+        got = out.decode().strip()
+        assert(tiers.index(got) <= tiers.index(tier))
+
 def test_polyad_from_bytes():
     b = b'\x02\x05\x05helloworld'
     p = pd.polyad(b)
@@ -156,6 +239,533 @@ def test_polyad_einval():
     for i in range(100):
         assert_raises(ValueError, pd.polyad, b'\xff' * 8)
 
+def test_polyad_group():
+    p = pd.polyad((b'hello', b'world'), group=True)
+    assert(b'\x80\x00\x02\x02\x00\x05\x05helloworld' == bytes(p))
+    q = pd.polyad(bytes(p))
+    assert([b'hello', b'world'] == list(map(bytes, q)))
+    for n in range(12):
+        items = [b'x' * (i * 97 % 300) for i in range(n)] + [b'y' * 70000] * (n % 3)
+        b = bytes(pd.polyad(items, group=True))
+        assert(items == list(map(bytes, pd.polyad(b))))
+        assert(items == list(map(bytes, pd.polyad(b + b'trailing'))))
+        assert(bytes(pd.polyad(items)) != b)
+        if n:
+            assert_raises(ValueError, pd.polyad, b[:5])
+    t = (1, 300, 70000, 1 << 40, 0)
+    b = pd.ntuple(t, group=True)
+    assert(b[:3] == b'\x80\x00\x02')
+    assert(t == pd.ntuple(b))
+    assert_raises(ValueError, pd.ntuple, t, group=True, bitpack=True)
+    assert_raises(ValueError, pd.polyad, b'\x80\x00\x02\x02\x10\x05\x05helloworld')
+    assert_raises(TypeError, pd.polyad, b'\x00', group=True)
+    # an extended header may not claim the plain varint format
+    for b in (b'\x80\x00\x00', b'\x80\x00\x00\x01\x00', b'\x80\x00'):
+        assert_raises(ValueError, pd.ntuple, b)
+        assert_raises(ValueError, pd.polyad, b)
+        assert(([], 0) == pd.load_many(b + b'\x00'))
+    # truncated and overlong groups
+    for b in (b'\x80\x00\x02' + pd.ntuple([40000000])[1:] + b'\xff' * 8,
+              b'\x80\x00\x02\x09\xff\x01\x02', b'\x80\x00\x02\x05\x00'):
+        for kw in ({}, {'lazy': True}, {'verify': True}):
+            assert_raises(ValueError, pd.polyad, b, **kw)
+
+def test_polyad_lazy():
+    for group in (False, True):
+        for n in (0, 1, 7, 8, 9, 33, 200):
+            items = [bytes([i % 256]) * (i * 7 % 150) for i in range(n)]
+            b = bytes(pd.polyad(items, group=group))
+            p = pd.polyad(b, lazy=True)
+            assert(n == len(p))
+            if n:
+                assert(items[-1] == bytes(p[n - 1]))
+                assert(items[0] == bytes(p[0]))
+            assert(items == list(map(bytes, pd.polyad(b, lazy=True))))
+            assert(b == bytes(pd.polyad(b + b'trailing', lazy=True)))
+    b = b'\x03\x01\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01\x00xy'
+    assert_raises(OverflowError, pd.polyad, b)
+    p = pd.polyad(b, lazy=True)
+    assert(3 == len(p))
+    assert_raises(OverflowError, p.__getitem__, 0)
+    assert_raises(OverflowError, bytes, p)
+    assert_raises(ValueError, pd.polyad, b'\x03\x01\x01', lazy=True)
+    assert_raises(TypeError, pd.polyad, [b'x'], lazy=True)
+
+def test_polyad_indexed():
+    p = pd.polyad((b'hello', b'world'), indexed=True)
+    assert(b'\x80\x00\x03\x02\x01\x00\x05\x0ahelloworld' == bytes(p))
+    assert([b'hello', b'world'] == list(map(bytes, pd.polyad(bytes(p)))))
+    for n, size in ((0, 0), (3, 1), (50, 100), (300, 1000), (5, 70000)):
+        items = [bytes([i % 256]) * (size * i % (size + 1)) for i in range(n)]
+        b = bytes(pd.polyad(items, indexed=True))
+        assert(items == list(map(bytes, pd.polyad(b, lazy=True))))
+        q = pd.polyad(b + b'trailing')
+        assert(b == bytes(q))
+        assert(items == [bytes(q[i]) for i in reversed(range(n))][::-1])
+    assert_raises(ValueError, pd.polyad, b[:-1])
+    assert_raises(ValueError, pd.polyad, b'\x80\x00\x03\x01\x03\x00\x00\x00')
+    assert_raises(ValueError, pd.polyad, b'\x80\x00\x03\x01\x01\x00\x05abc')
+    assert_raises(ValueError, pd.ntuple, b'\x80\x00\x03\x01\x01\x00\x00')
+    assert_raises(ValueError, pd.polyad, [b'x'], group=True, indexed=True)
+
+def test_polyad_iterable():
+    for kw in ({}, {'group': True}, {'indexed': True}):
+        for n in (0, 1, 5, 100, 3000):
+            items = [bytes([i % 256]) * (i % 200) for i in range(n)]
+            b = bytes(pd.polyad(items, **kw))
+            assert(b == bytes(pd.polyad((x for x in items), **kw)))
+            assert(b == bytes(pd.polyad(iter(items), **kw)))
+            assert(items == list(map(bytes, pd.polyad(x for x in items))))
+    assert(b'\x02\x01\x01ab' == bytes(pd.polyad(x for x in 'ab')))
+    assert_raises(TypeError, pd.polyad, (x for x in (b'x', 1)))
+    def fail():
+        yield b'x'
+        raise KeyError()
+    assert_raises(KeyError, pd.polyad, fail())
+    class hinted:
+        def __init__(self, hint):
+            self.hint = hint
+            self.items = iter([b'a', b'bc'])
+        def __iter__(self):
+            return self
+        def __next__(self):
+            return next(self.items)
+        def __length_hint__(self):
+            return self.hint
+    for hint in (0, 2, 10 ** 11, 1085102592571150091):
+        assert(b'\x02\x01\x02abc' == bytes(pd.polyad(hinted(hint))))
+
+def test_polyad_get():
+    leaf = [b'a', b'bc', b'']
+    for kw in ({}, {'group': True}, {'indexed': True}):
+        inner = [bytes(pd.polyad([b'x' * i] + leaf, **kw)) for i in range(40)]
+        mid = bytes(pd.polyad(inner, **kw))
+        p = pd.polyad([b'head', mid], **kw)
+        for i in range(40):
+            assert(b'x' * i == bytes(p.get((1, i, 0))))
+            assert(bytes(pd.polyad(pd.polyad(p[1])[i])[2]) == bytes(p.get([1, i, 2])))
+        assert(b'' == bytes(p.get((1, 39, -1))))
+        assert(mid == bytes(p.get(1)))
+        assert(p is p.get(()))
+        assert_raises(IndexError, p.get, (2,))
+        assert_raises(IndexError, p.get, (1, 40))
+        assert_raises(IndexError, p.get, (1, -41))
+        assert_raises(ValueError, p.get, (0, 0))
+        assert_raises(TypeError, p.get, ('x',))
+    b = pd.ntuple((1, 2), bitpack=True) + b'xyz'
+    assert(b'yz' == bytes(pd.polyad([b, b'']).get((0, 1))))
+
+def test_polyad_unpack():
+    items = [b'hello', b'', 'w\u00f6rld'.encode(), b'x' * 300]
+    for kw in ({}, {'group': True}, {'indexed': True}):
+        b = bytes(pd.polyad(items, **kw))
+        for p in (pd.polyad(b), pd.polyad(b, lazy=True)):
+            views = p.unpack()
+            assert(tuple(items) == tuple(map(bytes, views)))
+            assert(all(v.readonly and v.obj is p for v in views))
+            assert(tuple(items) == p.unpack(as_bytes=True))
+            assert(tuple(i.decode() for i in items) == p.unpack(encoding='utf-8'))
+            assert(items == [bytes(v) for v in p])
+            assert(items == [bytes(v) for v in iter(p)])
+        assert(tuple(items) == pd.unpack(b, as_bytes=True))
+        assert(tuple(items) == tuple(map(bytes, pd.unpack(memoryview(b)))))
+        assert(('hello', '', 'w\ufffd\ufffdrld', 'x' * 300) ==
+               pd.unpack(b, encoding='ascii', errors='replace'))
+    p = pd.polyad(items)
+    it = iter(p)
+    assert(b'hello' == bytes(next(it)))
+    del p
+    assert(items[1:] == list(map(bytes, it)))
+    assert_raises(StopIteration, next, it)
+    assert(() == pd.polyad([]).unpack() and [] == list(pd.polyad([])))
+    ba = bytearray(pd.polyad(items))
+    views = pd.unpack(ba)
+    assert_raises(BufferError, ba.extend, b'x')
+    del views
+    ba.extend(b'x')
+    assert_raises(UnicodeDecodeError, pd.polyad(items).unpack, encoding='ascii')
+    assert_raises(ValueError, pd.polyad(items).unpack, as_bytes=True, encoding='utf-8')
+    assert_raises(ValueError, pd.unpack, b'\x02\x05')
+    assert_raises(ValueError, pd.unpack, b'\x02\x05\x05hello')
+    assert_raises(ValueError, pd.unpack, bytes(pd.polyad([b'x' * 100000]))[:10])
+    assert_raises(TypeError, pd.unpack, 5)
+    # items are sliced at byte offsets of a buffer of wider items
+    from array import array
+    b = bytes(pd.polyad([b'abc', b'de', b'fgh']))
+    assert(12 == len(b))
+    for src in (array('H', b), memoryview(b).cast('I'), memoryview(b).cast('c'),
+                memoryview(b).cast('B', (2, 6))):
+        assert((b'abc', b'de', b'fgh') == tuple(map(bytes, pd.unpack(src))))
+        assert((b'abc', b'de', b'fgh') == pd.unpack(src, as_bytes=True))
+
+def test_polyad_freelist():
+    bufs = [bytes(pd.polyad([b'%d' % i] * i, group=i % 2 == 1)) for i in range(200)]
+    for kw in ({}, {'lazy': True}, {}):
+        ps = [pd.polyad(b, **kw) for b in bufs]
+        assert([[b'%d' % i] * i for i in range(200)] == [list(map(bytes, p)) for p in ps])
+        # reused objects of a smaller rank in a larger storage class
+        del ps[::3]
+        ps += [pd.polyad(b, **kw) for b in reversed(bufs)]
+        assert(all(bytes(p) in bufs for p in ps))
+        del ps
+    # the cached objects are released when the module is torn down
+    import os, subprocess
+    code = 'import polyadicts as pd; ps = [pd.polyad([b"x"] * i) for i in range(200)]; del ps'
+    env = dict(os.environ, PYTHONPATH=os.path.dirname(pd.__file__))
+    assert(0 == subprocess.call([sys.executable, '-X', 'dev', '-c', code], env=env))
+    small, large = pd.polyad(bufs[1]), pd.polyad(bufs[199])
+    assert(sys.getsizeof(small) < sys.getsizeof(large))
+    assert_raises(ValueError, pd.polyad, b'\x80')
+
+def test_polyad_verify():
+    items = [b'hello', b'', b'world' * 100]
+    for kw in ({}, {'group': True}, {'indexed': True}):
+        b = bytes(pd.polyad(items, **kw))
+        for mode in ({}, {'verify': True}, {'trust': True}, {'verify': True, 'lazy': True}):
+            assert(items == list(map(bytes, pd.polyad(b, **mode))))
+            assert(items == list(map(bytes, pd.polyad(b + b'trailing', **mode))))
+        assert_raises(ValueError, pd.polyad, b[:-1], verify=True)
+        assert_raises(ValueError, pd.polyad, b[:-1], verify=True, lazy=True)
+        assert(3 == len(pd.polyad(b[:-1], trust=True)))
+    assert(2 == len(pd.polyad(b'\x02\x05\x05hello')))
+    assert_raises(ValueError, pd.polyad, b'\x02\x05\x05hello', verify=True)
+    b = b'\x80\x00\x03\x02\x01\x00\x05\x03helloworld'
+    assert(2 == len(pd.polyad(b)))
+    assert_raises(ValueError, pd.polyad, b, verify=True)
+    assert_raises(ValueError, pd.polyad, b'\x00', verify=True, trust=True)
+    assert_raises(TypeError, pd.polyad, [b'x'], verify=True)
+    assert_raises(TypeError, pd.polyad, [b'x'], trust=True)
+
+def test_polyfile():
+    import os, tempfile
+    records = [[b'record', bytes([i]) * i] for i in range(100)]
+    kws = ({}, {'group': True}, {'indexed': True})
+    with tempfile.NamedTemporaryFile() as f:
+        for i, items in enumerate(records):
+            f.write(pd.polyad(items, **kws[i % 3]))
+        f.flush()
+        for kw in ({}, {'verify': True}, {'willneed': True}):
+            with pd.polyfile(f.name, **kw) as r:
+                ps = list(r)
+                assert(os.path.getsize(f.name) == r.tell())
+                assert(records == [list(map(bytes, p)) for p in ps])
+                assert_raises(BufferError, r.close)
+                del ps
+        r = pd.polyfile(f.fileno())
+        p = next(r)
+        assert(memoryview(r).readonly)
+        assert(bytes(p) == bytes(memoryview(r)[:len(bytes(p))]))
+        del p
+        r.close()
+        r.close()
+        assert_raises(ValueError, next, r)
+        assert_raises(ValueError, r.tell)
+        f.write(b'\x02\x05\x05hello')
+        f.flush()
+        for kw in ({}, {'verify': True}, {'trust': True}):
+            r = pd.polyfile(f.name, **kw)
+            assert(100 == sum(1 for _ in zip(range(100), r)))
+            assert_raises(ValueError, next, r)
+            r.close()
+    with tempfile.NamedTemporaryFile() as f:
+        assert([] == list(pd.polyfile(f.name)))
+        f.write(bytes(pd.polyad([b'x' * 100000]))[:10])
+        f.flush()
+        for kw in ({}, {'verify': True}, {'trust': True}):
+            with pd.polyfile(f.name, **kw) as r:
+                assert_raises(ValueError, next, r)
+    assert_raises(FileNotFoundError, pd.polyfile, '/nonexistent/polyfile')
+    assert_raises(TypeError, pd.polyfile, None)
+    assert_raises(ValueError, pd.polyfile, 0, verify=True, trust=True)
+
+def test_polyfile_index():
+    import os, tempfile
+    records = [[b'%d' % i, b'x' * (i % 300)] for i in range(1000)]
+    with tempfile.TemporaryDirectory() as d:
+        path = os.path.join(d, 'log')
+        with pd.polylog(path, bufsize=4096, index=64) as log:
+            for items in records[:10]:
+                log.append(items)
+            early = log.index()
+            for items in records[10:]:
+                log.append(items)
+            packed = log.index()
+        with pd.polyfile(path) as r:
+            offsets = []
+            for p in r:
+                offsets.append(r.tell() - len(bytes(p)))
+            del p
+            assert(packed == r.index(64))
+            assert(packed == r.index(64))
+            assert(r.index(1) != packed)
+        for kw in ({}, {'index': packed}, {'index': early}):
+            with pd.polyfile(path, **kw) as r:
+                for n in (999, 0, 64, 65, 500, 127):
+                    assert(offsets[n] == r.seek(n))
+                    assert(records[n] == list(map(bytes, next(r))))
+                assert(os.path.getsize(path) == r.seek(1000))
+                assert_raises(StopIteration, next, r)
+                assert_raises(IndexError, r.seek, 1001)
+                for n in (0, 1, 63, 64, 998):
+                    assert(n == r.find(offsets[n]))
+                    assert(n + 1 == r.find(offsets[n] + 1))
+                    assert(records[n + 1] == list(map(bytes, next(r))))
+                    r.seek(n)
+                assert(1000 == r.find(offsets[999] + 1))
+                assert(1000 == r.find(1 << 40))
+                assert_raises(OverflowError, r.seek, -1)
+        assert_raises(ValueError, pd.polyfile, path, index=b'\x01\x00')
+        assert_raises(ValueError, pd.polyfile, path, index=b'\x03\x00\x01\x00\x00')
+        # untrusted counts and offsets of an index
+        size = os.path.getsize(path)
+        for n, sz in ((2 ** 61 + 1, size), (2 ** 61 + 1, 2 ** 62), (4000 * 64 + 1, 2 ** 62)):
+            bad = pd.ntuple([1, n, sz]) + pd.ntuple([n])[1:] + bytes(4000)
+            assert_raises(ValueError, pd.polyfile, path, index=bad)
+        for deltas in ([10, 2 ** 64 - 5, 3], [0, 10, 0], [0, size, 1]):
+            bad = pd.ntuple([1, 3, size]) + pd.ntuple(deltas, bitpack=True)
+            assert_raises(ValueError, pd.polyfile, path, index=bad)
+        with tempfile.NamedTemporaryFile() as f:
+            assert_raises(ValueError, pd.polyfile, f.name, index=packed)
+        with pd.polylog(path) as log:
+            assert_raises(ValueError, log.index)
+
+def test_load_many():
+    records = [[b'%d' % i, b'x' * (i % 50)] * (i % 4) for i in range(2000)]
+    kws = ({}, {'group': True}, {'indexed': True})
+    buf = b''.join(bytes(pd.polyad(r, **kws[i % 3])) for i, r in enumerate(records))
+    for kw in ({}, {'lazy': True}, {'verify': True}, {'trust': True}):
+        ps, n = pd.load_many(buf, **kw)
+        assert(len(buf) == n)
+        assert(records == [list(map(bytes, p)) for p in ps])
+        assert(bytes(ps[7]) == bytes(pd.polyad(records[7], group=True)))
+    # one export of the buffer, shared by all the polyads
+    del ps
+    n = sys.getrefcount(buf)
+    ps, _ = pd.load_many(buf)
+    assert(n + 1 == sys.getrefcount(buf))
+    del ps
+    assert(n == sys.getrefcount(buf))
+    # a partial polyad at the end is left for more data
+    for cut in (1, 5, 20):
+        ps, n = pd.load_many(buf[:-cut])
+        assert(records[:-1] == [list(map(bytes, p)) for p in ps])
+        assert(len(buf) - len(bytes(pd.polyad(records[-1], **kws[1999 % 3]))) == n)
+    it = pd.iter_load(bytearray(buf))
+    assert(0 == it.tell())
+    p = next(it)
+    assert(records[0] == list(map(bytes, p)) and 1 == it.tell())
+    assert(records[1:] == [list(map(bytes, p)) for p in it])
+    assert(len(buf) == it.tell())
+    assert_raises(StopIteration, next, it)
+    ba = bytearray(buf)
+    ps, _ = pd.load_many(ba)
+    assert_raises(BufferError, ba.extend, b'x')
+    del ps, it, p
+    ba.extend(b'x')
+    # ranks growing past the storage left in each slab
+    grown = [[b'%d' % j for j in range(i * i % 1000)] for i in range(200)]
+    buf = b''.join(bytes(pd.polyad(r)) for r in grown)
+    ps, n = pd.load_many(buf)
+    assert(len(buf) == n and grown == [list(map(bytes, p)) for p in ps])
+    assert(grown == [list(map(bytes, p)) for p in pd.iter_load(buf)])
+    del ps
+    big = [b'y' * 10, b'z'] * 30000
+    ps, n = pd.load_many(bytes(pd.polyad(big)) * 2)
+    assert(2 == len(ps) and big == list(map(bytes, ps[1])))
+    # a rank whose storage size would wrap around
+    bad = pd.ntuple([2 ** 61 - 1])[1:] + bytes(100000)
+    assert_raises(MemoryError, pd.load_many, bad)
+    assert_raises(MemoryError, list, pd.iter_load(bad))
+    assert_raises(MemoryError, pd.polyad, bad)
+    assert(([], 0) == pd.load_many(b''))
+    assert(([], 0) == pd.load_many(b'\x02\x05'))
+    assert_raises(TypeError, pd.load_many, 5)
+    assert_raises(ValueError, pd.load_many, buf, verify=True, trust=True)
+
+def test_polyad_item_refs():
+    p = pd.polyad([b'abc', pd.polyad([b'de'])])
+    n = sys.getrefcount(p)
+    v, w = p[0], p.get((1, 0))
+    assert(n + 2 == sys.getrefcount(p))
+    del v, w
+    assert(n == sys.getrefcount(p))
+    v = pd.polyad([b'abc'])[0]
+    assert(b'abc' == bytes(v))
+    assert(b'abc' == bytes(pd.polyad([b'abc'], indexed=True).get(0)))
+
+def test_polyad_writev():
+    import os, tempfile
+    items = [b'hello', bytearray(b'big' * 100000), 'w\xf6rld', memoryview(b'')]
+    for kw in ({}, {'group': True}, {'indexed': True}):
+        b = bytes(pd.polyad(items, **kw))
+        iov = pd.polyad.iov(items, **kw)
+        assert(len(items) + 1 == len(iov))
+        assert(b == b''.join(map(bytes, iov)))
+        with tempfile.TemporaryFile() as f:
+            assert(len(b) == pd.polyad.writev(f, items, **kw))
+            f.seek(0)
+            assert(b == f.read())
+    assert(b'\x00' == b''.join(pd.polyad.iov([])))
+    assert_raises(TypeError, pd.polyad.iov, [1])
+    assert_raises(TypeError, pd.polyad.iov, None)
+    assert_raises(ValueError, pd.polyad.iov, [], group=True, indexed=True)
+    r, w = os.pipe()
+    os.close(w)
+    try:
+        assert_raises(OSError, pd.polyad.writev, r, [b'x'])
+    finally:
+        os.close(r)
+
+def test_polylog():
+    import os, tempfile, threading
+    with tempfile.TemporaryDirectory() as d:
+        path = os.path.join(d, 'log')
+        with pd.polylog(path, bufsize=4096, latency=0.001) as log:
+            def worker(k):
+                for i in range(200):
+                    off = log.append([b'%d' % k, b'x' * (i * 37 % 5000)], sync=i % 10 == 0)
+                    assert(off > 0)
+                log.sync()
+            threads = [threading.Thread(target=worker, args=(k,)) for k in range(4)]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            end = log.append(pd.polyad([b'last']))
+            assert_raises(TypeError, log.append, 1)
+        assert(end == os.path.getsize(path))
+        records = [list(map(bytes, p)) for p in pd.polyfile(path)]
+        assert(801 == len(records))
+        assert([b'last'] == records[-1])
+        for k in range(4):
+            mine = [r[1] for r in records if r[0] == b'%d' % k]
+            assert([b'x' * (i * 37 % 5000) for i in range(200)] == mine)
+        with pd.polylog(path) as log:
+            assert(1 == log.append(b'\x00', sync=True))
+            assert(end + 1 == os.path.getsize(path))
+        assert_raises(ValueError, log.append, b'\x00')
+        assert_raises(ValueError, pd.polylog, path, bufsize=100)
+        assert_raises(FileNotFoundError, pd.polylog, os.path.join(d, 'no', 'log'))
+
+def test_polyfile_scan():
+    import tempfile
+    records = [[b'%d' % i, b'x' * (i % 300)] for i in range(3000)]
+    def count(acc, p):
+        n, s = acc
+        return n + 1, s + int(bytes(p[0]))
+    with tempfile.NamedTemporaryFile() as f:
+        for i, items in enumerate(records):
+            f.write(pd.polyad(items, group=i % 2 == 1))
+        f.flush()
+        total = (len(records), sum(range(len(records))))
+        for kw in ({}, {'index': pd.polyfile(f.name).index(50)}):
+            with pd.polyfile(f.name, verify=True, **kw) as r:
+                for threads in (1, 3, 16):
+                    accs = r.scan(count, (0, 0), threads=threads)
+                    assert(threads == len(accs))
+                    assert(total == tuple(map(sum, zip(*accs))))
+                ps = r.scan(lambda acc, p: acc + [p], [], threads=4)
+                assert(records == [list(map(bytes, p)) for acc in ps for p in acc])
+                assert_raises(BufferError, r.close)
+                del ps
+                def fail(acc, p):
+                    if bytes(p[0]) == b'2999':
+                        raise KeyError(acc)
+                    return acc
+                assert_raises(KeyError, r.scan, fail, threads=4)
+                assert_raises(BufferError, r.scan, lambda acc, p: r.close())
+                assert_raises(BufferError, r.scan, lambda acc, p: r.index(7))
+                assert({0} == set(r.scan(lambda acc, p: r.seek(0), threads=4)) - {None})
+        f.write(b'\x02\x05\x05hello')
+        f.flush()
+        assert_raises(ValueError, pd.polyfile(f.name).scan, count, (0, 0))
+    with tempfile.NamedTemporaryFile() as f:
+        for items in records[:100]:
+            f.write(pd.polyad(items))
+        f.write(bytes(pd.polyad([b'x' * 100000]))[:10])
+        f.flush()
+        for kw in ({}, {'verify': True}, {'trust': True}):
+            with pd.polyfile(f.name, **kw) as r:
+                assert_raises(ValueError, r.scan, count, (0, 0), threads=2)
+    with tempfile.NamedTemporaryFile() as f:
+        assert([None, None] == pd.polyfile(f.name).scan(count, threads=2))
+    # ranks growing past the storage reused from record to record
+    grown = [[b'%d' % j for j in range(i * i % 1000)] for i in range(200)]
+    with tempfile.NamedTemporaryFile() as f:
+        for i, items in enumerate(grown):
+            f.write(pd.polyad(items, group=i % 2 == 1))
+        f.flush()
+        with pd.polyfile(f.name) as r:
+            packed = r.index(16)
+            assert(grown == [list(map(bytes, p)) for p in r])
+            accs = r.scan(lambda acc, p: acc + [list(map(bytes, p))], [], threads=3)
+            assert(grown == [items for acc in accs for items in acc])
+        # a rank whose storage size would wrap around
+        f.write(pd.ntuple([2 ** 61 - 1])[1:] + bytes(100000))
+        f.flush()
+        with pd.polyfile(f.name, index=packed) as r:
+            assert_raises(MemoryError, r.scan, lambda acc, p: acc, threads=3)
+            assert_raises(MemoryError, list, r)
+
+def test_nogil():
+    import threading
+    from array import array
+    big = bytes(range(256)) * 1024
+    nums = array('Q', range(0, 1 << 40, 1 << 22))
+    errors = []
+    def worker(k):
+        try:
+            for i in range(20):
+                items = [big, b'%d' % k, 'x' * (1 << 17), big[:i]]
+                p = pd.polyad(items, group=i % 2 == 1)
+                q = pd.polyad(bytes(p))
+                assert([big, b'%d' % k, b'x' * (1 << 17), big[:i]] == list(map(bytes, q)))
+                packed = pd.ntuple(nums, delta=i % 3)
+                assert(tuple(nums) == pd.ntuple(packed, delta=i % 3))
+                out = array('Q', bytes(len(nums) * 8))
+                assert(len(nums) == pd.ntuple(packed, out=out, delta=i % 3))
+                assert(nums == out)
+        except Exception as e:
+            errors.append(e)
+    threads = [threading.Thread(target=worker, args=(k,)) for k in range(4)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert([] == errors)
+
+def test_polyfile_nogil():
+    import tempfile, threading
+    with tempfile.NamedTemporaryFile() as f:
+        offsets = []
+        for i in range(1000):
+            offsets.append(f.tell())
+            f.write(pd.polyad([b'%d' % i, b'x' * (i % 300)]))
+        f.flush()
+        # the index is neither rebuilt nor closed under a concurrent seek
+        with pd.polyfile(f.name) as r:
+            r.index(64)
+            errors = []
+            def seeks():
+                try:
+                    for _ in range(300):
+                        assert(offsets[999] == r.seek(999))
+                        assert(999 == r.find(offsets[998] + 1))
+                except Exception as e:
+                    errors.append(e)
+            threads = [threading.Thread(target=seeks) for _ in range(4)]
+            for t in threads:
+                t.start()
+            for stride in range(1, 300):
+                try:
+                    r.index(stride)
+                except BufferError:
+                    pass
+            for t in threads:
+                t.join()
+            assert([] == errors)
+            assert(offsets[500] == r.seek(500))
+
 def test_polyad_enomem():
     from resource import getrlimit, getrusage, setrlimit
     from resource import RLIMIT_AS
@@ -219,6 +829,93 @@ def test_zag():
     test(0, 100)
     test((1 << 64) -10, (1 << 64))
 
+def test_zigzag_typed():
+    from array import array
+    t = tuple(range(-50, 50)) + ((-1 << 63), (1 << 63) - 1)
+    z = pd.zig(array('q', t))
+    assert('Q' == z.typecode)
+    assert(pd.zig(t) == tuple(z))
+    a = pd.zag(z)
+    assert('q' == a.typecode)
+    assert(t == tuple(a))
+    out = array('q', [0] * 200)
+    assert(out is pd.zag(z, out=out))
+    assert(t == tuple(out[:len(t)]))
+    assert(z is pd.zig(a, out=z))
+    assert_raises(ValueError, pd.zig, a, out=array('Q'))
+    assert_raises(TypeError, pd.zig, t, out=z)
+    t = (-3, 0, 3, (-1 << 62), (1 << 62) - 1) * 100
+    b = pd.ntuple(t, zigzag=True)
+    assert(pd.ntuple(pd.zig(t)) == b)
+    assert(b == pd.ntuple(array('q', t), zigzag=True))
+    assert(t == pd.ntuple(b, zigzag=True))
+    a = pd.ntuple(b, zigzag=True, array=True)
+    assert('q' == a.typecode)
+    assert(t == tuple(a))
+    assert_raises(OverflowError, pd.ntuple, [1 << 63], zigzag=True)
+    assert_raises(OverflowError, pd.ntuple, [-1 << 63], zigzag=True)
+
+def test_ntuple_delta():
+    from array import array
+    import random
+    r = random.Random(8)
+    ids = sorted(r.sample(range(1 << 40, (1 << 40) + 100000), 1000))
+    raw = pd.ntuple(ids)
+    b = pd.ntuple(ids, delta=True)
+    assert(3 * len(b) < len(raw))
+    assert(tuple(ids) == pd.ntuple(b, delta=True))
+    assert(b == pd.ntuple(array('Q', ids), delta=1))
+    assert(ids == pd.ntuple(b, delta=True, array=True).tolist())
+    ts = [1 << 40]
+    for i in range(999):
+        ts.append(ts[-1] + 1000 + r.randint(-3, 3))
+    b = pd.ntuple(ts, delta=2, zigzag=True)
+    assert(len(b) < 1100)
+    assert(tuple(ts) == pd.ntuple(b, delta=2, zigzag=True))
+    out = array('q', [0] * 1000)
+    assert(1000 == pd.ntuple(b, delta=2, zigzag=True, out=out))
+    assert(ts == out.tolist())
+    t = (5, -7, 1 << 60, -1 << 60, (1 << 60) - 1, 0, -1)
+    for delta in (1, 2):
+        b = pd.ntuple(t, delta=delta, zigzag=True)
+        assert(t == pd.ntuple(b, delta=delta, zigzag=True))
+    assert_raises(OverflowError, pd.ntuple, [-1 << 62, 1 << 62], delta=True, zigzag=True)
+    assert_raises(OverflowError, pd.ntuple, [2, 1], delta=True)
+    assert_raises(OverflowError, pd.ntuple, [1, 3, 4], delta=2)
+    assert_raises(ValueError, pd.ntuple, [1], delta=3)
+    assert(b'\x03\x01\x01\x01' == pd.ntuple([1, 2, 3], delta=True))
+    assert(b'\x03\x01\x00\x00' == pd.ntuple([1, 2, 3], delta=2))
+    assert(b'\x00' == pd.ntuple([], delta=2))
+
+def test_ntuple_bitpack():
+    from array import array
+    import random
+    r = random.Random(9)
+    for n in (1, 2, 127, 128, 129, 256, 300, 1000):
+        for w in (0, 1, 7, 13, 56, 57, 63):
+            base = r.getrandbits(40)
+            t = tuple(base + r.getrandbits(w) for i in range(n))
+            b = pd.ntuple(t, bitpack=True)
+            assert(b[:3] == b'\x80\x00\x01')
+            assert(t == pd.ntuple(b))
+            assert(t == tuple(pd.ntuple(b, array=True)))
+            assert_raises(ValueError, pd.ntuple, b[:-1])
+    t = tuple(r.getrandbits(12) for i in range(1000))
+    b = pd.ntuple(t, bitpack=True)
+    assert(len(b) < 1600 < len(pd.ntuple(t)))
+    assert(b == pd.ntuple(array('Q', t), bitpack=True))
+    t = tuple(range(10 ** 6, 10 ** 6 + 5000, 3))
+    b = pd.ntuple(t, bitpack=True, delta=True)
+    assert(len(b) < 1000)
+    assert(t == pd.ntuple(b, delta=True))
+    t = (-5, 3, 1 << 62, -1 << 63)
+    assert(t == pd.ntuple(pd.ntuple(t, bitpack=True, zigzag=True), zigzag=True))
+    t = (0, 1 << 63, (1 << 64) - 1)
+    assert(t == pd.ntuple(pd.ntuple(array('Q', t), bitpack=True)))
+    assert_raises(OverflowError, pd.ntuple, array('Q', [1 << 63]), bitpack=True)
+    assert_raises(ValueError, pd.ntuple, b'\x80\x00\x03\x01\x00\x00')
+    assert_raises(ValueError, pd.ntuple, b'\x80\x00\x01\x01\x00\x41')
+
 def test_varyad():
     v = pd.varyad(0)
     assert(0 == len(v))